@@ -0,0 +1,85 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/macro.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/idxset.h>
+#include <pulse/xmalloc.h>
+
+#include "atom.h"
+
+
+struct pa_policy_atoms {
+    pa_hashmap  *strings;       /* string -> atom */
+    pa_idxset   *pointers;      /* the atoms themselves */
+};
+
+
+struct pa_policy_atoms *pa_policy_atoms_new(void)
+{
+    struct pa_policy_atoms *atoms;
+
+    atoms = pa_xnew0(struct pa_policy_atoms, 1);
+
+    atoms->strings  = pa_hashmap_new_full(pa_idxset_string_hash_func,
+                                          pa_idxset_string_compare_func,
+                                          pa_xfree,
+                                          NULL);
+    atoms->pointers = pa_idxset_new(pa_idxset_trivial_hash_func,
+                                    pa_idxset_trivial_compare_func);
+
+    return atoms;
+}
+
+void pa_policy_atoms_free(struct pa_policy_atoms *atoms)
+{
+    if (atoms) {
+        pa_idxset_free(atoms->pointers, NULL);
+        pa_hashmap_free(atoms->strings);
+
+        pa_xfree(atoms);
+    }
+}
+
+const char *pa_policy_atom(struct pa_policy_atoms *atoms, const char *string)
+{
+    char *atom;
+
+    pa_assert(atoms);
+
+    if (string == NULL)
+        return NULL;
+
+    if ((atom = (char *) pa_policy_atom_find(atoms, string)) == NULL) {
+        atom = pa_xstrdup(string);
+
+        pa_hashmap_put(atoms->strings, atom, atom);
+        pa_idxset_put(atoms->pointers, atom, NULL);
+    }
+
+    return atom;
+}
+
+const char *pa_policy_atom_find(struct pa_policy_atoms *atoms, const char *string)
+{
+    pa_assert(atoms);
+
+    if (string == NULL)
+        return NULL;
+
+    /* callers mostly pass atoms they got earlier; spare hashing the string */
+    if (pa_idxset_get_by_data(atoms->pointers, string, NULL))
+        return string;
+
+    return pa_hashmap_get(atoms->strings, string);
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
@@ -0,0 +1,31 @@
+#ifndef fooatomfoo
+#define fooatomfoo
+
+/*
+ * Atoms are interned strings. Group names, device types and activity
+ * device names are interned when the configuration is loaded, so the
+ * same name is always represented by the same pointer and can be
+ * compared with '=='. Atoms stay valid until the table is freed.
+ */
+
+struct pa_policy_atoms;
+
+struct pa_policy_atoms *pa_policy_atoms_new(void);
+void pa_policy_atoms_free(struct pa_policy_atoms *);
+
+/* returns the atom of the string, creating it if needed */
+const char *pa_policy_atom(struct pa_policy_atoms *, const char *);
+
+/* returns the atom of the string or NULL if it was never interned */
+const char *pa_policy_atom_find(struct pa_policy_atoms *, const char *);
+
+
+#endif /* fooatomfoo */
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
@@ -23,6 +23,8 @@ static void handle_new_card(struct userdata *, struct pa_card *);
 static void handle_removed_card(struct userdata *, struct pa_card *);
 static void handle_card_profile_available_changed(struct userdata *u, pa_card *card);
 static void handle_card_profile_changed(struct userdata *u, pa_card *card);
+static int card_ext_profile_changes(struct userdata *, const char *,
+                                    struct pa_card **, pa_card_profile **);
 
 
 struct pa_card_evsubscr *pa_card_ext_subscription(struct userdata *u)
@@ -102,67 +104,42 @@ pa_hashmap *pa_card_ext_get_profiles(struct pa_card *card)
 
 int pa_card_ext_set_profile(struct userdata *u, char *type)
 {    
-    void            *state = NULL;
-    pa_idxset       *idxset;
-    struct pa_card  *card;
-    struct pa_classify_card_data *data;
-    struct pa_classify_card_data *datas[PA_POLICY_CARD_MAX_DEFS] = { NULL, NULL };
-    struct pa_card  *cards[PA_POLICY_CARD_MAX_DEFS] = { NULL, NULL };
-    int              priority;
-    const char      *pn;
-    const char      *override_pn;
+    struct pa_card  *cards[PA_POLICY_CARD_MAX_DEFS];
+    pa_card_profile *profiles[PA_POLICY_CARD_MAX_DEFS];
     const char      *cn;
-    pa_card_profile *ap;
-    pa_card_profile *new_profile;
     int              sts;
-    int              i;
+    int              i, n;
 
     pa_assert(u);
-    pa_assert(u->core);
-    pa_assert_se((idxset = u->core->cards));
 
     sts = 0;
+    n   = card_ext_profile_changes(u, type, cards, profiles);
 
-    while ((card = pa_idxset_iterate(idxset, &state, NULL)) != NULL) {
-        if (pa_classify_is_card_typeof(u, card, type, &data, &priority)) {
-            if (priority == 0) {
-                datas[0] = data;
-                cards[0] = card;
-            }
-            if (priority == 1) {
-                datas[1] = data;
-                cards[1] = card;
-            }
+    for (i = 0; i < n; i++) {
+        cn = pa_card_ext_get_name(cards[i]);
+
+        if (pa_card_set_profile(cards[i], profiles[i], false) < 0) {
+            sts = -1;
+            pa_log("failed to set card '%s' profile to '%s'", cn,
+                   profiles[i]->name);
         }
+        else
+            pa_log_debug("changed card '%s' profile to '%s'", cn,
+                         profiles[i]->name);
     }
 
-    for (i = 0; i < PA_POLICY_CARD_MAX_DEFS && datas[i]; i++) {
-
-        data = datas[i];
-        card = cards[i];
-
-        ap = card->active_profile;
-        pn = data->profile;
-        if (!pn)
-            continue;
-
-        if (pa_context_override_card_profile(u, card, pn, &override_pn))
-            pn = override_pn;
+    return sts;
+}
 
-        new_profile = pa_hashmap_get(card->profiles, pn);
-        cn = pa_card_ext_get_name(card);
+int pa_card_ext_changing_cards(struct userdata *u, const char *type,
+                               struct pa_card **cards)
+{
+    pa_card_profile *profiles[PA_POLICY_CARD_MAX_DEFS];
 
-        if (new_profile && (!ap || ap != new_profile)) {
-            if (pa_card_set_profile(card, new_profile, false) < 0) {
-                sts = -1;
-                pa_log("failed to set card '%s' profile to '%s'", cn, pn);
-            }
-            else
-                pa_log_debug("changed card '%s' profile to '%s'", cn, pn);
-        }
-    }
+    pa_assert(u);
+    pa_assert(cards);
 
-    return sts;
+    return card_ext_profile_changes(u, type, cards, profiles);
 }
 
 static pa_hook_result_t card_put(void *hook_data, void *call_data,
@@ -212,7 +189,7 @@ static pa_hook_result_t card_profile_changed(void *hook_data, void *call_data,
 
 static void handle_new_card(struct userdata *u, struct pa_card *card)
 {
-    struct pa_classify_result  *r;
+    struct pa_classify_result   r;
     const char                 *name;
     uint32_t                    idx;
     int                         ret;
@@ -226,7 +203,7 @@ static void handle_new_card(struct userdata *u, struct pa_card *card)
 
         if (pa_policy_log_level_debug()) {
             pa_classify_card(u, card, 0,0, false, &r);
-            buf = pa_policy_log_concat(r->types, r->count);
+            buf = pa_classify_result_to_string(u, &r);
 
             /* we don't usually need to save the type list to card property list
              * as it is not used for anything else than debugging. */
@@ -238,14 +215,12 @@ static void handle_new_card(struct userdata *u, struct pa_card *card)
             }
 
             pa_log_debug("new card '%s' (idx=%d%s%s)",
-                         name, idx, r->count > 0 ? ", type=" : "", buf);
+                         name, idx, pa_classify_result_count(&r) > 0 ? ", type=" : "", buf);
             pa_xfree(buf);
-            pa_xfree(r);
         }
 
         pa_classify_card(u, card, PA_POLICY_DISABLE_NOTIFY, 0, true, &r);
-        pa_policy_send_device_state(u, PA_POLICY_CONNECTED, r);
-        pa_xfree(r);
+        pa_policy_send_device_state(u, PA_POLICY_CONNECTED, &r);
     }
 }
 
@@ -253,7 +228,7 @@ static void handle_removed_card(struct userdata *u, struct pa_card *card)
 {
     const char *name;
     uint32_t  idx;
-    struct pa_classify_result *r;
+    struct pa_classify_result  r;
     char *buf;
 
     if (card && u) {
@@ -264,31 +239,28 @@ static void handle_removed_card(struct userdata *u, struct pa_card *card)
 
         if (pa_policy_log_level_debug()) {
             pa_classify_card(u, card, 0, 0, false, &r);
-            buf = pa_policy_log_concat(r->types, r->count);
+            buf = pa_classify_result_to_string(u, &r);
             pa_log_debug("remove card '%s' (idx=%d%s%s)",
-                         name, idx, r->count > 0 ? ", type=" : "", buf);
+                         name, idx, pa_classify_result_count(&r) > 0 ? ", type=" : "", buf);
             pa_xfree(buf);
-            pa_xfree(r);
         }
 
         pa_classify_card(u, card, PA_POLICY_DISABLE_NOTIFY, 0, false, &r);
-        pa_policy_send_device_state(u, PA_POLICY_DISCONNECTED, r);
-        pa_xfree(r);
+        pa_policy_send_device_state(u, PA_POLICY_DISCONNECTED, &r);
     }
 }
 
 static void handle_card_profile_available_changed(struct userdata *u, pa_card *card)
 {
-    struct pa_classify_result *r;
+    struct pa_classify_result  r;
 
     pa_classify_card(u, card, PA_POLICY_DISABLE_NOTIFY, 0, true, &r);
-    pa_policy_send_device_state(u, PA_POLICY_CONNECTED, r);
-    pa_xfree(r);
+    pa_policy_send_device_state(u, PA_POLICY_CONNECTED, &r);
 }
 
 static void handle_card_profile_changed(struct userdata *u, pa_card *card)
 {
-    struct pa_classify_result  *r;
+    struct pa_classify_result   r;
     pa_card_profile            *p;
 
     pa_classify_card(u, card, PA_POLICY_NOTIFY_PROFILE_CHANGED, PA_POLICY_NOTIFY_PROFILE_CHANGED,
@@ -296,18 +268,76 @@ static void handle_card_profile_changed(struct userdata *u, pa_card *card)
 
     p = card->active_profile;
 
-    if (r->count > 0) {
+    if (pa_classify_result_count(&r) > 0) {
         if (pa_policy_log_level_debug()) {
             char *buf;
-            buf = pa_policy_log_concat(r->types, r->count);
+            buf = pa_classify_result_to_string(u, &r);
             pa_log_debug("card profile changed: type=\"%s\", profile=\"%s\"", buf, p->name);
             pa_xfree(buf);
         }
 
-        pa_policy_send_card_state(u, r, p->name);
+        pa_policy_send_card_state(u, &r, p->name);
+    }
+
+}
+
+static int card_ext_profile_changes(struct userdata *u, const char *type,
+                                    struct pa_card **changed,
+                                    pa_card_profile **profiles)
+{
+    void            *state = NULL;
+    pa_idxset       *idxset;
+    struct pa_card  *card;
+    struct pa_classify_card_data *data;
+    struct pa_classify_card_data *datas[PA_POLICY_CARD_MAX_DEFS] = { NULL, NULL };
+    struct pa_card  *cards[PA_POLICY_CARD_MAX_DEFS] = { NULL, NULL };
+    int              priority;
+    const char      *pn;
+    const char      *override_pn;
+    pa_card_profile *ap;
+    pa_card_profile *new_profile;
+    int              i, n;
+
+    pa_assert(u);
+    pa_assert(u->core);
+    pa_assert_se((idxset = u->core->cards));
+
+    while ((card = pa_idxset_iterate(idxset, &state, NULL)) != NULL) {
+        if (pa_classify_is_card_typeof(u, card, type, &data, &priority)) {
+            if (priority == 0) {
+                datas[0] = data;
+                cards[0] = card;
+            }
+            if (priority == 1) {
+                datas[1] = data;
+                cards[1] = card;
+            }
+        }
+    }
+
+    for (i = n = 0; i < PA_POLICY_CARD_MAX_DEFS && datas[i]; i++) {
+
+        data = datas[i];
+        card = cards[i];
+
+        ap = card->active_profile;
+        pn = data->profile;
+        if (!pn)
+            continue;
+
+        if (pa_context_override_card_profile(u, card, pn, &override_pn))
+            pn = override_pn;
+
+        new_profile = pa_hashmap_get(card->profiles, pn);
+
+        if (new_profile && (!ap || ap != new_profile)) {
+            changed[n]  = card;
+            profiles[n] = new_profile;
+            n++;
+        }
     }
 
-    pa_xfree(r);
+    return n;
 }
 
 /*
@@ -16,6 +16,10 @@ void pa_card_ext_discover(struct userdata *);
 const char *pa_card_ext_get_name(struct pa_card *);
 pa_hashmap *pa_card_ext_get_profiles(struct pa_card *card);
 int pa_card_ext_set_profile(struct userdata *, char *);
+/* Cards whose profile pa_card_ext_set_profile() would change; the array
+ * must have room for PA_POLICY_CARD_MAX_DEFS cards. */
+int pa_card_ext_changing_cards(struct userdata *, const char *,
+                               struct pa_card **);
 
 #endif
 
@@ -26,6 +26,7 @@
 #include "variable.h"
 #include "context.h"
 #include "match.h"
+#include "atom.h"
 
 
 
@@ -37,7 +38,8 @@ static char *arg_dump(int, char **, char *, size_t);
 
 static void app_id_free(pa_classify_app_id *app);
 static void app_id_map_free_all(pa_hashmap *app_id_map);
-static void app_id_map_insert(pa_hashmap *app_id_map, const char *app_id,
+static void app_id_map_insert(struct pa_policy_match_keys *keys,
+                              pa_hashmap *app_id_map, const char *app_id,
                               const char *prop, enum pa_classify_method method,
                               const char *arg, const char *group);
 static void app_id_map_remove(pa_hashmap *app_id_map, const char *app_id,
@@ -50,16 +52,29 @@ static pa_classify_app_id *app_id_map_find(pa_hashmap *app_id_map, const char *a
                                            const char *arg);
 
 static void streams_free(struct pa_classify_stream_def *);
-static void streams_add(struct userdata *u, struct pa_classify_stream_def **, const char *,
+static void streams_add(struct userdata *u, struct pa_classify_stream *, const char *,
                         enum pa_classify_method, const char *, const char *,
                         const char *, uid_t, const char *, const char *, uint32_t,
                         const char *);
-static const char *streams_get_group(struct userdata *u, struct pa_classify_stream_def **, pa_proplist *,
-                                     const char *, uid_t, const char *, uint32_t *);
+static const char *streams_get_group(struct userdata *u, struct pa_classify_stream *, pa_proplist *,
+                                     const char *, uid_t, const char *, uint32_t *,
+                                     pa_proplist **, bool *);
 static struct pa_classify_stream_def
-            *streams_find(struct userdata *u, struct pa_classify_stream_def **, pa_proplist *,
-                          const char *, const char *, uid_t, const char *,
-                          struct pa_classify_stream_def **);
+            *streams_find(struct userdata *u, struct pa_classify_stream *, pa_proplist *,
+                          const char *, const char *, uid_t, const char *, bool *);
+
+static void stream_index_init(struct pa_classify_stream_index *);
+static void stream_index_done(struct pa_classify_stream_index *);
+static void stream_index_add(struct pa_classify_stream_index *,
+                             struct pa_classify_stream_def *);
+
+static void stream_keys_add(struct pa_classify *, pa_policy_match_object *);
+static char *client_cache_signature(struct pa_classify *, struct pa_client *,
+                                    pa_proplist *);
+static struct pa_classify_cache_entry *client_cache_get(struct pa_classify *,
+                                                        uint32_t, const char *);
+static void client_cache_put(struct pa_classify *, uint32_t, char *,
+                             const char *, uint32_t, pa_proplist *);
 
 static void device_def_free(struct pa_classify_device_def *d);
 static void devices_free(struct pa_classify_device *);
@@ -68,9 +83,11 @@ static void devices_add(struct userdata *u, struct pa_classify_device **p_device
                         enum pa_classify_method method, const char *arg,
                         pa_idxset *ports, const char *module, const char *module_args,
                         uint32_t flags, uint32_t port_change_delay);
-static int devices_classify(struct pa_classify_device *devices, const void *object,
+static int devices_classify(struct pa_policy_match_keys *keys,
+                            struct pa_classify_device *devices,
+                            enum pa_policy_object_type obj_type, const void *object,
                             uint32_t flag_mask, uint32_t flag_value,
-                            struct pa_classify_result **result);
+                            struct pa_classify_result *result);
 static int devices_is_typeof(struct pa_classify_device_def *defs, const void *object,
                              const char *type, struct pa_classify_device_data **data);
 
@@ -79,8 +96,9 @@ static void cards_free(struct pa_classify_card *);
 static void cards_add(struct userdata *u, struct pa_classify_card **, const char *,
                       enum pa_classify_method[PA_POLICY_CARD_MAX_DEFS], char **, char **,
                       uint32_t[PA_POLICY_CARD_MAX_DEFS]);
-static int  cards_classify(struct pa_classify_card *, pa_card *, pa_hashmap *card_profiles,
-                           uint32_t,uint32_t, bool reclassify, struct pa_classify_result **result);
+static int  cards_classify(struct pa_policy_match_keys *,
+                           struct pa_classify_card *, pa_card *, pa_hashmap *card_profiles,
+                           uint32_t,uint32_t, bool reclassify, struct pa_classify_result *result);
 static int card_is_typeof(struct pa_classify_card_def *, pa_card *card,
                           const char *, struct pa_classify_card_data **, int *priority);
 
@@ -93,21 +111,131 @@ static int port_device_is_typeof(struct pa_classify_device_def *,
 static pa_hook_result_t module_unlink_hook_cb(pa_core *c, pa_module *m, struct pa_classify *cl);
 
 
-static struct pa_classify_result *classify_result_malloc(uint32_t type_count)
+static int classify_type_id(struct pa_classify *classify, const char *type)
 {
-    struct pa_classify_result *r;
+    int id;
 
-    r = pa_xmalloc(sizeof(struct pa_classify_result) +
-                   sizeof(char *) * (type_count > 0 ? type_count - 1 : 0));
-    r->count = 0;
+    /* types are atoms */
+    for (id = 0;  id < classify->ntype;  id++) {
+        if (classify->types[id] == type)
+            return id;
+    }
+
+    if (classify->ntype >= PA_POLICY_CLASSIFY_TYPE_MAX) {
+        pa_log("too many device types, can't add '%s'", type);
+        return -1;
+    }
+
+    classify->types[classify->ntype] = type;
+
+    return classify->ntype++;
+}
+
+void pa_classify_result_clear(struct pa_classify_result *r)
+{
+    pa_assert(r);
+
+    memset(r->bits, 0, sizeof(r->bits));
+}
+
+void pa_classify_result_add(struct pa_classify_result *r, int type_id)
+{
+    pa_assert(r);
+    pa_assert(type_id >= 0 && type_id < PA_POLICY_CLASSIFY_TYPE_MAX);
+
+    r->bits[type_id / 32] |= 1U << (type_id % 32);
+}
+
+void pa_classify_result_union(struct pa_classify_result *r,
+                              const struct pa_classify_result *other)
+{
+    int i;
+
+    pa_assert(r);
+    pa_assert(other);
+
+    for (i = 0;  i < PA_POLICY_CLASSIFY_TYPE_WORDS;  i++)
+        r->bits[i] |= other->bits[i];
+}
+
+void pa_classify_result_diff(struct pa_classify_result *r,
+                             const struct pa_classify_result *other)
+{
+    int i;
+
+    pa_assert(r);
+    pa_assert(other);
+
+    for (i = 0;  i < PA_POLICY_CLASSIFY_TYPE_WORDS;  i++)
+        r->bits[i] &= ~other->bits[i];
+}
 
-    return r;
+int pa_classify_result_count(const struct pa_classify_result *r)
+{
+    int count = 0;
+    int i;
+
+    pa_assert(r);
+
+    for (i = 0;  i < PA_POLICY_CLASSIFY_TYPE_WORDS;  i++)
+        count += __builtin_popcount(r->bits[i]);
+
+    return count;
 }
 
-static void classify_result_append(struct pa_classify_result **r, const char *type)
+int pa_classify_result_next(const struct pa_classify_result *r, int type_id)
 {
-    (*r)->types[(*r)->count] = type;
-    (*r)->count++;
+    uint32_t word;
+    int      i;
+
+    pa_assert(r);
+
+    if (type_id < 0)
+        type_id = 0;
+
+    for (i = type_id / 32;  i < PA_POLICY_CLASSIFY_TYPE_WORDS;  i++) {
+        word = r->bits[i];
+
+        /* ignore the bits below type_id in its own word */
+        if (i == type_id / 32)
+            word &= ~0U << (type_id % 32);
+
+        if (word)
+            return i * 32 + __builtin_ctz(word);
+    }
+
+    return -1;
+}
+
+const char *pa_classify_type_name(struct userdata *u, int type_id)
+{
+    pa_assert(u);
+    pa_assert(u->classify);
+    pa_assert(type_id >= 0 && type_id < u->classify->ntype);
+
+    return u->classify->types[type_id];
+}
+
+char *pa_classify_result_to_string(struct userdata *u,
+                                   const struct pa_classify_result *r)
+{
+    pa_strbuf *buf;
+    int        id;
+    bool       first = true;
+
+    pa_assert(u);
+    pa_assert(r);
+
+    buf = pa_strbuf_new();
+
+    PA_CLASSIFY_RESULT_FOREACH(id, r) {
+        if (!first)
+            pa_strbuf_putc(buf, ' ');
+        first = false;
+        pa_strbuf_puts(buf, pa_classify_type_name(u, id));
+    }
+
+    return pa_strbuf_to_string_free(buf);
 }
 
 static void unload_module(pa_module *m)
@@ -134,6 +262,13 @@ struct pa_classify *pa_classify_new(struct userdata *u)
                                                  pa_idxset_string_compare_func,
                                                  pa_xfree,
                                                  NULL);
+    stream_index_init(&cl->streams.index);
+    cl->stream_keys  = pa_idxset_new(pa_idxset_string_hash_func,
+                                     pa_idxset_string_compare_func);
+    cl->client_cache = pa_hashmap_new_full(pa_idxset_trivial_hash_func,
+                                           pa_idxset_trivial_compare_func,
+                                           NULL,
+                                           (pa_free_cb_t) pa_hashmap_free);
 
     return cl;
 }
@@ -145,6 +280,11 @@ void pa_classify_free(struct userdata *u)
 
     if (cl) {
         app_id_map_free_all(cl->streams.app_id_map);
+        if (cl->client_cache)
+            pa_hashmap_free(cl->client_cache);
+        if (cl->stream_keys)
+            pa_idxset_free(cl->stream_keys, pa_xfree);
+        stream_index_done(&cl->streams.index);
         streams_free(cl->streams.defs);
         devices_free(cl->sinks);
         devices_free(cl->sources);
@@ -248,7 +388,7 @@ void pa_classify_add_stream(struct userdata *u, const char *prop,
             }
         }
 
-        streams_add(u, &classify->streams.defs, prop,method,arg,
+        streams_add(u, &classify->streams, prop,method,arg,
                     clnam, sname, uid, exe, grnam, flags, set_properties);
     }
 }
@@ -276,13 +416,19 @@ void pa_classify_register_app_id(struct userdata *u, const char *app_id, const c
                                  const char *group)
 {
     struct pa_classify *classify;
+    pa_classify_app_id *app;
 
     pa_assert(u);
     pa_assert_se((classify = u->classify));
 
     if (app_id && group) {
-        app_id_map_insert(classify->streams.app_id_map, app_id,
-                          prop, method, arg, group);
+        app_id_map_insert(u->match_keys, classify->streams.app_id_map, app_id,
+                          prop, method, arg, pa_policy_atom(u->atoms, group));
+
+        if ((app = pa_hashmap_get(classify->streams.app_id_map, app_id)))
+            stream_keys_add(classify, app->match);
+
+        pa_classify_invalidate_clients(u);
     }
 }
 
@@ -297,9 +443,30 @@ void pa_classify_unregister_app_id(struct userdata *u, const char *app_id, const
     if (app_id) {
         app_id_map_remove(classify->streams.app_id_map, app_id,
                           prop, method, arg);
+        pa_classify_invalidate_clients(u);
     }
 }
 
+void pa_classify_invalidate_client(struct userdata *u, uint32_t client_idx)
+{
+    struct pa_classify *classify;
+
+    pa_assert(u);
+
+    if ((classify = u->classify) && classify->client_cache)
+        pa_hashmap_remove_and_free(classify->client_cache, PA_UINT32_TO_PTR(client_idx));
+}
+
+void pa_classify_invalidate_clients(struct userdata *u)
+{
+    struct pa_classify *classify;
+
+    pa_assert(u);
+
+    if ((classify = u->classify) && classify->client_cache)
+        pa_hashmap_remove_all(classify->client_cache);
+}
+
 const char *pa_classify_sink_input(struct userdata *u, struct pa_sink_input *sinp,
                                    uint32_t *flags)
 {
@@ -364,7 +531,7 @@ pa_classify_source_output_by_data(struct userdata *u,
 
 int pa_classify_sink(struct userdata *u, struct pa_sink *sink,
                      uint32_t flag_mask, uint32_t flag_value,
-                     struct pa_classify_result **result)
+                     struct pa_classify_result *result)
 {
     struct pa_classify *classify;
     struct pa_classify_device *devices;
@@ -375,13 +542,13 @@ int pa_classify_sink(struct userdata *u, struct pa_sink *sink,
     pa_assert_se((devices = classify->sinks));
     pa_assert(result);
 
-    return devices_classify(devices, sink,
+    return devices_classify(u->match_keys, devices, pa_policy_object_sink, sink,
                             flag_mask, flag_value, result);
 }
 
 int pa_classify_source(struct userdata *u, struct pa_source *source,
                        uint32_t flag_mask, uint32_t flag_value,
-                       struct pa_classify_result **result)
+                       struct pa_classify_result *result)
 {
     struct pa_classify *classify;
     struct pa_classify_device *devices;
@@ -392,13 +559,13 @@ int pa_classify_source(struct userdata *u, struct pa_source *source,
     pa_assert_se((devices = classify->sources));
     pa_assert(result);
 
-    return devices_classify(devices, source,
+    return devices_classify(u->match_keys, devices, pa_policy_object_source, source,
                             flag_mask, flag_value, result);
 }
 
 int pa_classify_card(struct userdata *u, struct pa_card *card,
                      uint32_t flag_mask, uint32_t flag_value,
-                     bool reclassify, struct pa_classify_result **result)
+                     bool reclassify, struct pa_classify_result *result)
 {
     struct pa_classify *classify;
     struct pa_classify_card *cards;
@@ -412,11 +579,11 @@ int pa_classify_card(struct userdata *u, struct pa_card *card,
 
     profs = pa_card_ext_get_profiles(card);
 
-    return cards_classify(cards, card, profs, flag_mask,flag_value, reclassify, result);
+    return cards_classify(u->match_keys, cards, card, profs, flag_mask,flag_value, reclassify, result);
 }
 
 int pa_classify_card_all_types(struct userdata *u,
-                               struct pa_classify_result **result)
+                               struct pa_classify_result *result)
 {
     struct pa_classify *classify;
     struct pa_classify_card *cards;
@@ -428,33 +595,36 @@ int pa_classify_card_all_types(struct userdata *u,
     pa_assert(classify->cards);
     pa_assert_se((cards = classify->cards));
 
-    *result = classify_result_malloc(cards->ndef);
+    pa_classify_result_clear(result);
 
     for (d = cards->defs;  d->type;  d++) {
-        classify_result_append(result, d->type);
+        if (d->type_id >= 0)
+            pa_classify_result_add(result, d->type_id);
     }
 
-    return (*result)->count;
+    return pa_classify_result_count(result);
 }
 
 static int devices_all_types(struct pa_classify_device *devices,
-                             struct pa_classify_result **result)
+                             struct pa_classify_result *result)
 {
     struct pa_classify_device_def *d;
 
     pa_assert(devices);
     pa_assert(result);
 
-    *result = classify_result_malloc(devices->ndef);
+    pa_classify_result_clear(result);
 
-    for (d = devices->defs;  d->type;  d++)
-        classify_result_append(result, d->type);
+    for (d = devices->defs;  d->type;  d++) {
+        if (d->type_id >= 0)
+            pa_classify_result_add(result, d->type_id);
+    }
 
-    return (*result)->count;
+    return pa_classify_result_count(result);
 }
 
 int pa_classify_sink_all_types(struct userdata *u,
-                               struct pa_classify_result **result)
+                               struct pa_classify_result *result)
 {
     struct pa_classify *classify;
     struct pa_classify_device *devices;
@@ -469,7 +639,7 @@ int pa_classify_sink_all_types(struct userdata *u,
 }
 
 int pa_classify_source_all_types(struct userdata *u,
-                                 struct pa_classify_result **result)
+                                 struct pa_classify_result *result)
 {
     struct pa_classify *classify;
     struct pa_classify_device *devices;
@@ -495,7 +665,7 @@ int pa_classify_is_sink_typeof(struct userdata *u, struct pa_sink *sink,
     pa_assert(classify->sinks);
     pa_assert_se((defs = classify->sinks->defs));
 
-    if (!sink || !type)
+    if (!sink || !(type = pa_policy_atom_find(u->atoms, type)))
         return false;
 
     return devices_is_typeof(defs, sink, type, d);
@@ -514,7 +684,7 @@ int pa_classify_is_source_typeof(struct userdata *u, struct pa_source *source,
     pa_assert(classify->sources);
     pa_assert_se((defs = classify->sources->defs));
 
-    if (!source || !type)
+    if (!source || !(type = pa_policy_atom_find(u->atoms, type)))
         return false;
 
     return devices_is_typeof(defs, source, type, d);
@@ -532,7 +702,7 @@ int pa_classify_is_card_typeof(struct userdata *u, struct pa_card *card,
     pa_assert(classify->cards);
     pa_assert_se((defs = classify->cards->defs));
 
-    if (!card || !type)
+    if (!card || !(type = pa_policy_atom_find(u->atoms, type)))
         return false;
 
     return card_is_typeof(defs, card, type, d, priority);
@@ -551,7 +721,7 @@ int pa_classify_is_port_sink_typeof(struct userdata *u, struct pa_sink *sink,
     pa_assert(classify->sinks);
     pa_assert_se((defs = classify->sinks->defs));
 
-    if (!sink || !type)
+    if (!sink || !(type = pa_policy_atom_find(u->atoms, type)))
         return false;
 
     return port_device_is_typeof(defs, pa_policy_object_sink, sink, type, d);
@@ -571,7 +741,7 @@ int pa_classify_is_port_source_typeof(struct userdata *u,
     pa_assert(classify->sources);
     pa_assert_se((defs = classify->sources->defs));
 
-    if (!source || !type)
+    if (!source || !(type = pa_policy_atom_find(u->atoms, type)))
         return false;
 
     return port_device_is_typeof(defs, pa_policy_object_source, source, type, d);
@@ -679,11 +849,11 @@ void pa_classify_update_modules(struct userdata *u, uint32_t dir, const char *ty
 
     m = &u->classify->module[dir];
 
-    if (!m->module)
+    if (!m->module || !(type = pa_policy_atom_find(u->atoms, type)))
         return;
 
     for (d = defs;  d->type;  d++) {
-        if (pa_streq(type, d->type)) {
+        if (type == d->type) {
             new_def = d;
             break;
         }
@@ -693,7 +863,7 @@ void pa_classify_update_modules(struct userdata *u, uint32_t dir, const char *ty
         return;
 
     for (d = defs;  d->type;  d++) {
-        if (!pa_streq(type, d->type)) {
+        if (type != d->type) {
             if (d->data.module) {
                 if (pa_safe_streq(m->module_name, new_def->data.module) &&
                     pa_safe_streq(m->module_args, new_def->data.module_args)) {
@@ -739,7 +909,11 @@ static const char *find_group_for_client(struct userdata  *u,
 {
     struct pa_classify *classify;
     pa_hashmap *app_id_map;
-    struct pa_classify_stream_def **defs;
+    struct pa_classify_stream *streams;
+    struct pa_classify_cache_entry *cached;
+    pa_proplist *properties = NULL;
+    char       *signature;
+    bool        dynamic = false;
     const char *app_id  = NULL;         /* client application id */
     const char *clnam   = "";           /* client's name in PA */
     uid_t       uid     = (uid_t) -1;   /* client process user ID */
@@ -751,7 +925,7 @@ static const char *find_group_for_client(struct userdata  *u,
     pa_assert_se((classify = u->classify));
 
     app_id_map = classify->streams.app_id_map;
-    defs = &classify->streams.defs;
+    streams = &classify->streams;
 
     if (client == NULL) {
         /* sample cache initiated sink-inputs don't have a client, but sample's proplist
@@ -761,17 +935,39 @@ static const char *find_group_for_client(struct userdata  *u,
         if (!(exe = pa_proplist_gets(proplist, PA_PROP_APPLICATION_PROCESS_BINARY)))
             exe = "";
 
-        group = streams_get_group(u, defs, proplist, clnam, uid, exe, &flags);
+        group = streams_get_group(u, streams, proplist, clnam, uid, exe, &flags,
+                                  NULL, NULL);
     } else {
-        app_id = pa_client_ext_app_id(client);
+        signature = client_cache_signature(classify, client, proplist);
 
-        if (!(group = app_id_get_group(app_id_map, app_id, proplist))) {
+        if ((cached = client_cache_get(classify, client->index, signature))) {
+            pa_xfree(signature);
 
-            clnam = pa_client_ext_name(client);
-            uid   = pa_client_ext_uid(client);
-            exe   = pa_client_ext_exe(client);
+            group = cached->group;
+            flags = cached->flags;
 
-            group = streams_get_group(u, defs, proplist, clnam, uid, exe, &flags);
+            if (cached->properties)
+                pa_proplist_update(proplist, PA_UPDATE_REPLACE, cached->properties);
+        }
+        else {
+            app_id = pa_client_ext_app_id(client);
+
+            if (!(group = app_id_get_group(app_id_map, app_id, proplist))) {
+
+                clnam = pa_client_ext_name(client);
+                uid   = pa_client_ext_uid(u, client);
+                exe   = pa_client_ext_exe(client);
+
+                group = streams_get_group(u, streams, proplist, clnam, uid, exe, &flags,
+                                          &properties, &dynamic);
+            }
+
+            /* results depending on the state of the routing sinks can't be
+             * reused for the next stream */
+            if (!dynamic)
+                client_cache_put(classify, client->index, signature, group, flags, properties);
+            else
+                pa_xfree(signature);
         }
     }
 
@@ -788,6 +984,110 @@ static const char *find_group_for_client(struct userdata  *u,
     return group;
 }
 
+static void stream_keys_add(struct pa_classify *classify, pa_policy_match_object *m)
+{
+    pa_assert(classify);
+
+    if (m && m->target == pa_object_property && m->target_def) {
+        if (!pa_idxset_get_by_data(classify->stream_keys, m->target_def, NULL)) {
+            pa_idxset_put(classify->stream_keys, pa_xstrdup(m->target_def), NULL);
+            pa_hashmap_remove_all(classify->client_cache);
+        }
+    }
+}
+
+/* The signature covers everything the classification of a client's
+ * stream depends on: the client identity and the stream properties
+ * referenced by stream or app_id matching. Values are length-prefixed
+ * to keep the signature unambiguous. */
+static char *client_cache_signature(struct pa_classify *classify,
+                                    struct pa_client *client,
+                                    pa_proplist *proplist)
+{
+    static const char *client_keys[] = {
+        PA_PROP_APPLICATION_NAME,
+        PA_PROP_APPLICATION_PROCESS_USER,
+        PA_PROP_APPLICATION_PROCESS_BINARY,
+        NULL
+    };
+
+    pa_strbuf  *buf;
+    const char *key;
+    const char *value;
+    uint32_t    idx;
+    int         i;
+
+    buf = pa_strbuf_new();
+
+    if ((value = pa_client_ext_app_id(client)))
+        pa_strbuf_printf(buf, "%zu:%s", strlen(value), value);
+    else
+        pa_strbuf_putc(buf, '-');
+
+    for (i = 0;  client_keys[i];  i++) {
+        if ((value = pa_proplist_gets(client->proplist, client_keys[i])))
+            pa_strbuf_printf(buf, "%zu:%s", strlen(value), value);
+        else
+            pa_strbuf_putc(buf, '-');
+    }
+
+    PA_IDXSET_FOREACH(key, classify->stream_keys, idx) {
+        if ((value = pa_proplist_gets(proplist, key)))
+            pa_strbuf_printf(buf, "%zu:%s", strlen(value), value);
+        else
+            pa_strbuf_putc(buf, '-');
+    }
+
+    return pa_strbuf_to_string_free(buf);
+}
+
+static struct pa_classify_cache_entry *client_cache_get(struct pa_classify *classify,
+                                                        uint32_t client_idx,
+                                                        const char *signature)
+{
+    pa_hashmap *entries;
+
+    if (!(entries = pa_hashmap_get(classify->client_cache, PA_UINT32_TO_PTR(client_idx))))
+        return NULL;
+
+    return pa_hashmap_get(entries, signature);
+}
+
+static void client_cache_put(struct pa_classify *classify, uint32_t client_idx,
+                             char *signature, const char *group, uint32_t flags,
+                             pa_proplist *properties)
+{
+#define MAX_ENTRIES_PER_CLIENT 32
+
+    pa_hashmap *entries;
+    struct pa_classify_cache_entry *entry;
+
+    if (!(entries = pa_hashmap_get(classify->client_cache, PA_UINT32_TO_PTR(client_idx)))) {
+        entries = pa_hashmap_new_full(pa_idxset_string_hash_func,
+                                      pa_idxset_string_compare_func,
+                                      pa_xfree,
+                                      pa_xfree);
+        pa_hashmap_put(classify->client_cache, PA_UINT32_TO_PTR(client_idx), entries);
+    }
+    else if (pa_hashmap_size(entries) >= MAX_ENTRIES_PER_CLIENT) {
+        /* the client keeps varying some referenced property, e.g. the
+         * media name; start over instead of growing without bounds */
+        pa_hashmap_remove_all(entries);
+    }
+
+    entry = pa_xnew0(struct pa_classify_cache_entry, 1);
+    entry->group      = group;
+    entry->flags      = flags;
+    entry->properties = properties;
+
+    if (pa_hashmap_put(entries, signature, entry) < 0) {
+        pa_xfree(signature);
+        pa_xfree(entry);
+    }
+
+#undef MAX_ENTRIES_PER_CLIENT
+}
+
 #if 0
 static char *arg_dump(int argc, char **argv, char *buf, size_t len)
 {
@@ -817,7 +1117,6 @@ static char *arg_dump(int argc, char **argv, char *buf, size_t len)
 static void app_id_free(pa_classify_app_id *app)
 {
     if (app) {
-        pa_xfree(app->group);
         pa_xfree(app);
     }
 }
@@ -832,7 +1131,8 @@ static void app_id_map_free_all(pa_hashmap *app_id_map)
     }
 }
 
-static void app_id_map_insert(pa_hashmap *app_id_map, const char *app_id,
+static void app_id_map_insert(struct pa_policy_match_keys *keys,
+                              pa_hashmap *app_id_map, const char *app_id,
                               const char *prop, enum pa_classify_method method,
                               const char *arg, const char *group)
 {
@@ -849,15 +1149,15 @@ static void app_id_map_insert(pa_hashmap *app_id_map, const char *app_id,
         pa_log_debug("app_id group changed (%s|%s) %s -> %s", app_id, tmp ? tmp : "",
                                                               app->group, group);
 
-        pa_xfree(app->group);
-        app->group = pa_xstrdup(group);
+        app->group = group;
     } else {
         app = pa_xnew0(pa_classify_app_id, 1);
 
-        app->group = pa_xstrdup(group);
+        app->group = group;
 
         if (prop) {
-            app->match = pa_policy_match_property_new(pa_policy_object_proplist,
+            app->match = pa_policy_match_property_new(keys,
+                                                      pa_policy_object_proplist,
                                                       prop,
                                                       method,
                                                       arg);
@@ -945,7 +1245,6 @@ static void streams_free(struct pa_classify_stream_def *defs)
         pa_xfree(stream->exe);
         pa_xfree(stream->clnam);
         pa_xfree(stream->sname);
-        pa_xfree(stream->group);
         if (stream->properties)
             pa_proplist_free(stream->properties);
 
@@ -953,17 +1252,16 @@ static void streams_free(struct pa_classify_stream_def *defs)
     }
 }
 
-static void streams_add(struct userdata *u, struct pa_classify_stream_def **defs, const char *prop,
+static void streams_add(struct userdata *u, struct pa_classify_stream *streams, const char *prop,
                         enum pa_classify_method method, const char *arg, const char *clnam,
                         const char *sname, uid_t uid, const char *exe, const char *group, uint32_t flags,
                         const char *set_properties)
 {
     struct pa_classify_stream_def *d;
-    struct pa_classify_stream_def *prev;
     pa_proplist *proplist = NULL;
     char        *method_def = NULL;
 
-    pa_assert(defs);
+    pa_assert(streams);
     pa_assert(group);
 
     proplist = pa_proplist_new();
@@ -972,21 +1270,23 @@ static void streams_add(struct userdata *u, struct pa_classify_stream_def **defs
         pa_proplist_sets(proplist, prop, arg);
     }
 
-    if ((d = streams_find(u, defs, proplist, clnam, sname, uid, exe, &prev)) != NULL) {
+    if ((d = streams_find(u, streams, proplist, clnam, sname, uid, exe, NULL)) != NULL) {
         pa_log_info("redefinition of stream");
-        pa_xfree(d->group);
+        d->grp = NULL;
     }
     else {
         d = pa_xnew0(struct pa_classify_stream_def, 1);
 
         if (prop && arg) {
-            d->stream_match = pa_policy_match_property_new(pa_policy_object_proplist,
+            d->stream_match = pa_policy_match_property_new(u->match_keys,
+                                                           pa_policy_object_proplist,
                                                            prop,
                                                            method,
                                                            arg);
             if (!d->stream_match) {
                 pa_log("%s: invalid stream definition [%s:%s]", __FUNCTION__, prop, arg);
                 pa_xfree(d);
+                pa_proplist_free(proplist);
                 return;
             }
 
@@ -1001,13 +1301,19 @@ static void streams_add(struct userdata *u, struct pa_classify_stream_def **defs
         /* Stream action, identified streams' proplists are merged with what's defined here. */
         d->properties   = set_properties ? pa_proplist_from_string(set_properties) : NULL;
 
-        prev->next = d;
+        if (streams->index.tail)
+            streams->index.tail->next = d;
+        else
+            streams->defs = d;
+
+        stream_index_add(&streams->index, d);
+        stream_keys_add(u->classify, d->stream_match);
 
         pa_log_debug("stream added (%d|%s|%s|%s|%d)", uid, exe?exe:"<null>",
                      clnam?clnam:"<null>", method_def, d->sact);
     }
 
-    d->group = pa_xstrdup(group);
+    d->group = pa_policy_atom(u->atoms, group);
     d->flags = flags;
 
     pa_proplist_free(proplist);
@@ -1015,18 +1321,20 @@ static void streams_add(struct userdata *u, struct pa_classify_stream_def **defs
 }
 
 static const char *streams_get_group(struct userdata *u,
-                                     struct pa_classify_stream_def **defs,
+                                     struct pa_classify_stream *streams,
                                      pa_proplist *proplist,
                                      const char *clnam, uid_t uid, const char *exe,
-                                     uint32_t *flags_ret)
+                                     uint32_t *flags_ret,
+                                     pa_proplist **properties_ret,
+                                     bool *dynamic_ret)
 {
     struct pa_classify_stream_def *d;
     const char *group;
     uint32_t flags;
 
-    pa_assert(defs);
+    pa_assert(streams);
 
-    if ((d = streams_find(u, defs, proplist, clnam, NULL, uid, exe, NULL)) == NULL) {
+    if ((d = streams_find(u, streams, proplist, clnam, NULL, uid, exe, dynamic_ret)) == NULL) {
         group = NULL;
         flags = 0;
     }
@@ -1038,60 +1346,154 @@ static const char *streams_get_group(struct userdata *u,
     if (flags_ret != NULL)
         *flags_ret = flags;
 
+    if (properties_ret != NULL)
+        *properties_ret = d ? d->properties : NULL;
+
     if (d && d->properties)
         pa_proplist_update(proplist, PA_UPDATE_REPLACE, d->properties);
 
     return group;
 }
 
-static bool group_sink_is_active(struct userdata *u, const char *group_name)
+/* Groups are never removed while the module is running, but they may be
+ * defined after the streams referring to them, so resolve them lazily. */
+static struct pa_policy_group *stream_def_group(struct userdata *u,
+                                                struct pa_classify_stream_def *d)
+{
+    if (!d->grp)
+        d->grp = pa_policy_group_find(u, d->group);
+
+    return d->grp;
+}
+
+static bool stream_def_matches(struct pa_classify_stream_def *d,
+                               struct pa_policy_match_snapshot *snap, const char *clnam,
+                               const char *sname, uid_t uid, const char *exe)
+{
+#define PROPERTY_MATCH     (!d->stream_match || pa_policy_match_snapshot(d->stream_match, snap))
+#define STRING_MATCH_OF(m) (!d->m || (m && d->m && !strcmp(m, d->m)))
+#define ID_MATCH_OF(m)     (d->m == -1 || m == d->m)
+
+    return PROPERTY_MATCH         &&
+           STRING_MATCH_OF(clnam) &&
+           ID_MATCH_OF(uid)       &&
+           (!sname || (sname && d->sname && !strcmp(sname, d->sname))) &&
+           STRING_MATCH_OF(exe);
+
+#undef PROPERTY_MATCH
+#undef STRING_MATCH_OF
+#undef ID_MATCH_OF
+}
+
+/* case for dynamically changing active sink. */
+static bool stream_def_is_dynamic(struct userdata *u, struct pa_classify_stream_def *d)
 {
     struct pa_policy_group *group;
-    pa_sink *sink;
 
-    if ((group = pa_policy_group_find(u, group_name))) {
-        if (!(group->flags & PA_POLICY_GROUP_FLAG_DYNAMIC_SINK))
-            return true;
+    if (d->sact != -1)
+        return true;
 
-        if ((sink = pa_policy_group_find_sink(u, group))) {
-            pa_log_debug("sink %s is %srunning", sink->name, sink->state == PA_SINK_RUNNING ? "" : "not ");
-            return sink->state == PA_SINK_RUNNING;
-        }
-    }
+    if ((group = stream_def_group(u, d)))
+        return (group->flags & PA_POLICY_GROUP_FLAG_DYNAMIC_SINK) ? true : false;
 
     return false;
 }
 
+static bool stream_def_sink_is_active(struct userdata *u, struct pa_classify_stream_def *d)
+{
+    struct pa_policy_group *group;
+
+    if (d->sact == 0)
+        return false;
+
+    /* sink_active is kept up to date by the sink hooks */
+    return (group = stream_def_group(u, d)) && group->sink_active;
+}
+
 static struct pa_classify_stream_def *
-streams_find(struct userdata *u, struct pa_classify_stream_def **defs, pa_proplist *proplist,
+streams_find(struct userdata *u, struct pa_classify_stream *streams, pa_proplist *proplist,
              const char *clnam, const char *sname, uid_t uid, const char *exe,
-             struct pa_classify_stream_def **prev_ret)
+             bool *dynamic_ret)
 {
-#define PROPERTY_MATCH     (!d->stream_match || pa_policy_match(d->stream_match, proplist))
-#define STRING_MATCH_OF(m) (!d->m || (m && d->m && !strcmp(m, d->m)))
-#define ID_MATCH_OF(m)     (d->m == -1 || m == d->m)
+#define MAX_CHAINS 16
+
+    struct pa_classify_stream_index  *index;
+    struct pa_classify_stream_bucket *b;
+    struct pa_classify_stream_def    *chain_buf[MAX_CHAINS];
+    struct pa_classify_stream_def   **chain;
+    struct pa_classify_stream_def    *d;
+    struct pa_policy_match_snapshot   snap;
+    pa_hashmap *values;
+    const char *prop;
+    const char *value;
+    void       *state;
+    unsigned    max;
+    unsigned    n;
+    unsigned    i;
+    unsigned    min;
+    bool        dynamic = false;
+
+    pa_assert(streams);
+
+    index = &streams->index;
+    max   = pa_hashmap_size(index->props) + 4;
+    chain = (max <= MAX_CHAINS) ? chain_buf : pa_xnew(struct pa_classify_stream_def *, max);
+    n     = 0;
+
+    /* collect the candidate buckets; each bucket is in definition order */
+    PA_HASHMAP_FOREACH_KV(prop, values, index->props, state) {
+        if ((value = pa_proplist_gets(proplist, prop)) &&
+            (b = pa_hashmap_get(values, value)))
+            chain[n++] = b->first;
+    }
 
-    struct pa_classify_stream_def *prev;
-    struct pa_classify_stream_def *d;
+    if (exe && (b = pa_hashmap_get(index->exes, exe)))
+        chain[n++] = b->first;
 
-    for (prev = (struct pa_classify_stream_def *)defs;
-         (d = prev->next) != NULL;
-         prev = prev->next)
-    {
-        if (PROPERTY_MATCH         &&
-            STRING_MATCH_OF(clnam) &&
-            ID_MATCH_OF(uid)       &&
-            /* case for dynamically changing active sink. */
-            (!sname || (sname && d->sname && !strcmp(sname, d->sname))) &&
-            ((d->sact == -1 || d->sact == 1) && group_sink_is_active(u, d->group)) &&
-            /* end special case */
-            STRING_MATCH_OF(exe)      )
+    if (clnam && (b = pa_hashmap_get(index->clnams, clnam)))
+        chain[n++] = b->first;
+
+    if (uid != (uid_t)-1 && (b = pa_hashmap_get(index->uids, PA_UINT32_TO_PTR(uid))))
+        chain[n++] = b->first;
+
+    if (index->any.first)
+        chain[n++] = index->any.first;
+
+    pa_policy_match_snapshot_init(&snap, u->match_keys, pa_policy_object_proplist, proplist);
+
+    /* merge the buckets by definition order, so that the first matching
+     * definition wins just like with a linear scan of all definitions */
+    for (d = NULL;;) {
+        for (min = n, i = 0;  i < n;  i++) {
+            if (chain[i] && (min == n || chain[i]->seq < chain[min]->seq))
+                min = i;
+        }
+
+        if (min == n)
             break;
 
+        d = chain[min];
+        chain[min] = d->bucket_next;
+
+        if (stream_def_matches(d, &snap, clnam, sname, uid, exe)) {
+            /* the result depends on the state of the routing sink */
+            if (stream_def_is_dynamic(u, d))
+                dynamic = true;
+
+            if (stream_def_sink_is_active(u, d))
+                break;
+        }
+
+        d = NULL;
     }
 
-    if (prev_ret)
-        *prev_ret = prev;
+    pa_policy_match_snapshot_done(&snap);
+
+    if (dynamic_ret)
+        *dynamic_ret = dynamic;
+
+    if (chain != chain_buf)
+        pa_xfree(chain);
 
 #if 0
     {
@@ -1104,9 +1506,124 @@ streams_find(struct userdata *u, struct pa_classify_stream_def **defs, pa_propli
 
     return d;
 
-#undef PROPERTY_MATCH
-#undef STRING_MATCH_OF
-#undef ID_MATCH_OF
+#undef MAX_CHAINS
+}
+
+static void stream_bucket_free(void *data)
+{
+    pa_xfree(data);
+}
+
+static void stream_index_init(struct pa_classify_stream_index *index)
+{
+    pa_assert(index);
+
+    index->ndef   = 0;
+    index->tail   = NULL;
+    index->props  = pa_hashmap_new_full(pa_idxset_string_hash_func,
+                                        pa_idxset_string_compare_func,
+                                        pa_xfree,
+                                        (pa_free_cb_t) pa_hashmap_free);
+    index->exes   = pa_hashmap_new_full(pa_idxset_string_hash_func,
+                                        pa_idxset_string_compare_func,
+                                        pa_xfree,
+                                        stream_bucket_free);
+    index->clnams = pa_hashmap_new_full(pa_idxset_string_hash_func,
+                                        pa_idxset_string_compare_func,
+                                        pa_xfree,
+                                        stream_bucket_free);
+    index->uids   = pa_hashmap_new_full(pa_idxset_trivial_hash_func,
+                                        pa_idxset_trivial_compare_func,
+                                        NULL,
+                                        stream_bucket_free);
+    index->any.first = NULL;
+    index->any.last  = NULL;
+}
+
+static void stream_index_done(struct pa_classify_stream_index *index)
+{
+    pa_assert(index);
+
+    if (index->props)
+        pa_hashmap_free(index->props);
+    if (index->exes)
+        pa_hashmap_free(index->exes);
+    if (index->clnams)
+        pa_hashmap_free(index->clnams);
+    if (index->uids)
+        pa_hashmap_free(index->uids);
+
+    memset(index, 0, sizeof(*index));
+}
+
+static struct pa_classify_stream_bucket *stream_bucket_get(pa_hashmap *map,
+                                                           const void *key,
+                                                           bool dup_key)
+{
+    struct pa_classify_stream_bucket *b;
+
+    if (!(b = pa_hashmap_get(map, key))) {
+        b = pa_xnew0(struct pa_classify_stream_bucket, 1);
+        pa_hashmap_put(map, dup_key ? pa_xstrdup(key) : (void *) key, b);
+    }
+
+    return b;
+}
+
+static void stream_index_add(struct pa_classify_stream_index *index,
+                             struct pa_classify_stream_def *d)
+{
+    struct pa_classify_stream_bucket *b;
+    pa_policy_match_object *m;
+    pa_hashmap *values;
+    const char *key;
+
+    pa_assert(index);
+    pa_assert(d);
+
+    m = d->stream_match;
+
+    /* pick the most selective exact-match key of the definition */
+    if (m && m->target == pa_object_property && m->method == pa_method_equals) {
+        if (!(values = pa_hashmap_get(index->props, m->target_def))) {
+            values = pa_hashmap_new_full(pa_idxset_string_hash_func,
+                                         pa_idxset_string_compare_func,
+                                         pa_xfree,
+                                         stream_bucket_free);
+            pa_hashmap_put(index->props, pa_xstrdup(m->target_def), values);
+        }
+        b = stream_bucket_get(values, m->arg_def, true);
+        key = "property";
+    }
+    else if (d->exe) {
+        b = stream_bucket_get(index->exes, d->exe, true);
+        key = "exe";
+    }
+    else if (d->clnam) {
+        b = stream_bucket_get(index->clnams, d->clnam, true);
+        key = "client";
+    }
+    else if (d->uid != (uid_t)-1) {
+        b = stream_bucket_get(index->uids, PA_UINT32_TO_PTR(d->uid), false);
+        key = "uid";
+    }
+    else {
+        b = &index->any;
+        key = "none";
+    }
+
+    d->seq = index->ndef++;
+    d->bucket_next = NULL;
+
+    if (b->last)
+        b->last->bucket_next = d;
+    else
+        b->first = d;
+
+    b->last = d;
+    index->tail = d;
+
+    pa_log_debug("stream #%u indexed by %s", d->seq, key);
 }
 
 static void classify_port_entry_free(void *data) {
@@ -1123,8 +1640,6 @@ static void device_def_free(struct pa_classify_device_def *d)
 {
     pa_assert(d);
 
-    pa_xfree(d->type);
-
     if (d->data.ports)
         pa_idxset_free(d->data.ports, classify_port_entry_free);
 
@@ -1169,8 +1684,10 @@ static void devices_add(struct userdata *u, struct pa_classify_device **p_device
     pa_policy_var_update(u, module);
     pa_policy_var_update(u, module_args);
 
+    type = pa_policy_atom(u->atoms, type);
+
     for (d = devs->defs;  d->type;  d++) {
-        if (pa_streq(type, d->type)) {
+        if (type == d->type) {
             replace = true;
             break;
         }
@@ -1186,7 +1703,7 @@ static void devices_add(struct userdata *u, struct pa_classify_device **p_device
         memset(d+1, 0, sizeof(devs->defs[0]));
     }
 
-    d->dev_match = pa_policy_match_new(obj_type,
+    d->dev_match = pa_policy_match_new(u->match_keys, obj_type,
                                        pa_streq(prop, "(name)") ? pa_object_name : pa_object_property,
                                        prop,
                                        method,
@@ -1198,7 +1715,8 @@ static void devices_add(struct userdata *u, struct pa_classify_device **p_device
         return;
     }
 
-    d->type = pa_xstrdup(type);
+    d->type = type;
+    d->type_id = classify_type_id(u->classify, type);
 
     buf = pa_strbuf_new();
 
@@ -1217,7 +1735,7 @@ static void devices_add(struct userdata *u, struct pa_classify_device **p_device
             port = pa_xnew0(struct pa_classify_port_entry, 1);
 
             port->port_name = pa_xstrdup(pa_policy_var(u, port_config->port_name));
-            port->device_match = pa_policy_match_new(obj_type,
+            port->device_match = pa_policy_match_new(u->match_keys, obj_type,
                                                      pa_streq(port_config->prop, "(name)") ?
                                                         pa_object_name : pa_object_property,
                                                      pa_policy_var(u, port_config->prop),
@@ -1263,26 +1781,31 @@ static void devices_add(struct userdata *u, struct pa_classify_device **p_device
     pa_xfree(ports_string);
 }
 
-static int devices_classify(struct pa_classify_device *devices, const void *object,
+static int devices_classify(struct pa_policy_match_keys *keys,
+                            struct pa_classify_device *devices,
+                            enum pa_policy_object_type obj_type, const void *object,
                             uint32_t flag_mask, uint32_t flag_value,
-                            struct pa_classify_result **result)
+                            struct pa_classify_result *result)
 {
     struct pa_classify_device_def *d;
+    struct pa_policy_match_snapshot snap;
 
     pa_assert(result);
 
-    *result = classify_result_malloc(devices->ndef);
+    pa_classify_result_clear(result);
+
+    pa_policy_match_snapshot_init(&snap, keys, obj_type, object);
 
     for (d = devices->defs;  d->type;  d++) {
-        if (pa_policy_match(d->dev_match, object)) {
-            if ((d->data.flags & flag_mask) == flag_value) {
-                pa_assert((*result)->count < devices->ndef);
-                classify_result_append(result, d->type);
-            }
+        if (pa_policy_match_snapshot(d->dev_match, &snap)) {
+            if ((d->data.flags & flag_mask) == flag_value && d->type_id >= 0)
+                pa_classify_result_add(result, d->type_id);
         }
     }
 
-    return (*result)->count;
+    pa_policy_match_snapshot_done(&snap);
+
+    return pa_classify_result_count(result);
 }
 
 static int devices_is_typeof(struct pa_classify_device_def *defs, const void *object,
@@ -1291,7 +1814,7 @@ static int devices_is_typeof(struct pa_classify_device_def *defs, const void *ob
     struct pa_classify_device_def *d;
 
     for (d = defs;  d->type;  d++) {
-        if (!strcmp(type, d->type)) {
+        if (type == d->type) {
             if (pa_policy_match(d->dev_match, object)) {
                 if (data != NULL)
                     *data = &d->data;
@@ -1310,8 +1833,6 @@ static void card_def_free(struct pa_classify_card_def *d)
 
     pa_assert(d);
 
-    pa_xfree(d->type);
-
     for (i = 0; i < PA_POLICY_CARD_MAX_DEFS; i++) {
         pa_xfree(d->data[i].profile);
         pa_policy_match_free(d->data[i].card_match);
@@ -1348,8 +1869,10 @@ static void cards_add(struct userdata *u, struct pa_classify_card **p_cards,
     /* update variable */
     pa_policy_var_update(u, type);
 
+    type = pa_policy_atom(u->atoms, type);
+
     for (d = cards->defs;  d->type;  d++) {
-        if (pa_streq(type, d->type)) {
+        if (type == d->type) {
             replace = true;
             break;
         }
@@ -1365,7 +1888,8 @@ static void cards_add(struct userdata *u, struct pa_classify_card **p_cards,
         memset(d+1, 0, sizeof(cards->defs[0]));
     }
 
-    d->type    = pa_xstrdup(type);
+    d->type    = type;
+    d->type_id = classify_type_id(u->classify, type);
 
     for (i = 0; i < PA_POLICY_CARD_MAX_DEFS && profiles[i]; i++) {
 
@@ -1402,21 +1926,24 @@ fail:
     memset(d, 0, sizeof(*d));
 }
 
-static int cards_classify(struct pa_classify_card *cards,
+static int cards_classify(struct pa_policy_match_keys *keys,
+                          struct pa_classify_card *cards,
                           pa_card *card, pa_hashmap *card_profiles,
                           uint32_t flag_mask, uint32_t flag_value,
-                          bool reclassify, struct pa_classify_result **result)
+                          bool reclassify, struct pa_classify_result *result)
 {
     struct pa_classify_card_def  *d;
     struct pa_classify_card_data *data;
+    struct pa_policy_match_snapshot snap;
     pa_card_profile *cp;
     int              i;
     bool             supports_profile;
 
     pa_assert(result);
 
-    /* one card definition may have multiple sets of defines */
-    *result = classify_result_malloc(cards->ndef * PA_POLICY_CARD_MAX_DEFS);
+    pa_classify_result_clear(result);
+
+    pa_policy_match_snapshot_init(&snap, keys, pa_policy_object_card, card);
 
     for (d = cards->defs;  d->type;  d++) {
 
@@ -1426,7 +1953,7 @@ static int cards_classify(struct pa_classify_card *cards,
 
             data = &d->data[i];
 
-            if (pa_policy_match(data->card_match, card)) {
+            if (pa_policy_match_snapshot(data->card_match, &snap)) {
                 supports_profile = false;
 
                 if (data->profile == NULL)
@@ -1438,16 +1965,18 @@ static int cards_classify(struct pa_classify_card *cards,
                     }
                 }
 
-                if (supports_profile && (data->flags & flag_mask) == flag_value) {
-                    pa_assert((*result)->count < cards->ndef);
-                    classify_result_append(result, d->type);
-                }
+                /* one card definition may have multiple sets of defines */
+                if (supports_profile && (data->flags & flag_mask) == flag_value &&
+                    d->type_id >= 0)
+                    pa_classify_result_add(result, d->type_id);
             }
         }
 
     }
 
-    return (*result)->count;
+    pa_policy_match_snapshot_done(&snap);
+
+    return pa_classify_result_count(result);
 }
 
 static int card_is_typeof(struct pa_classify_card_def *defs, pa_card *card,
@@ -1457,7 +1986,7 @@ static int card_is_typeof(struct pa_classify_card_def *defs, pa_card *card,
     int i;
 
     for (d = defs;  d->type;  d++) {
-        if (!strcmp(type, d->type)) {
+        if (type == d->type) {
 
             for (i = 0; i < PA_POLICY_CARD_MAX_DEFS && d->data[i].profile; i++) {
                 if (pa_policy_match(d->data[i].card_match, card)) {
@@ -1484,7 +2013,7 @@ static int port_device_is_typeof(struct pa_classify_device_def *defs,
     struct pa_classify_device_def *d;
 
     for (d = defs;  d->type;  d++) {
-        if (pa_streq(type, d->type)) {
+        if (type == d->type) {
             if (d->data.ports && pa_classify_get_port_entry(&d->data, obj_type, obj)) {
                 if (data)
                     *data = &d->data;
@@ -1520,44 +2049,33 @@ int pa_classify_port_get_device_types(struct userdata *u,
                                       pa_direction_t direction,
                                       const char *port_name,
                                       int flags,
-                                      struct pa_classify_result **p_types)
+                                      struct pa_classify_result *types)
 {
     struct pa_classify_port_entry *port;
-    struct pa_classify_result *result = NULL;
+    struct pa_classify_result result;
     uint32_t idx;
-    int count = 0;
 
     pa_assert(u);
     pa_assert(port_name);
 
     struct pa_classify_device_def *d = direction == PA_DIRECTION_OUTPUT ? u->classify->sinks->defs : u->classify->sources->defs;
 
-    if (p_types) {
-        *p_types = pa_xnew0(struct pa_classify_result, 1);
-        result = *p_types;
-    }
+    pa_classify_result_clear(&result);
 
     for (;  d->type;  d++) {
         if (!d->data.ports || (flags && !(d->data.flags & flags)))
             continue;
 
         PA_IDXSET_FOREACH(port, d->data.ports, idx) {
-            if (pa_streq(port_name, port->port_name)) {
-                if (result) {
-                    if (result->count == 0) {
-                        result->types[result->count++] = d->type;
-                    } else {
-                        size_t newsize = sizeof(*result) + sizeof(result->types[0]) * (result->count + 1);
-                        result = *p_types = pa_xrealloc(result, newsize);
-                        result->types[result->count++] = d->type;
-                    }
-                }
-                count++;
-            }
+            if (pa_streq(port_name, port->port_name) && d->type_id >= 0)
+                pa_classify_result_add(&result, d->type_id);
         }
     }
 
-    return count;
+    if (types)
+        *types = result;
+
+    return pa_classify_result_count(&result);
 }
 
 /*
@@ -34,19 +34,26 @@
 
 #define PA_POLICY_CARD_MAX_DEFS     (2)
 
+/* configured device and card types */
+#define PA_POLICY_CLASSIFY_TYPE_MAX    (128)
+#define PA_POLICY_CLASSIFY_TYPE_WORDS  (PA_POLICY_CLASSIFY_TYPE_MAX / 32)
+
 struct pa_sink;
 struct pa_source;
 struct pa_sink_input;
 struct pa_sink_input_new_data;
 struct pa_card;
+struct pa_policy_group;
 
 typedef struct pa_classify_app_id {
     pa_policy_match_object      *match;
-    char                        *group;
+    const char                  *group;   /* atom */
 } pa_classify_app_id;
 
 struct pa_classify_stream_def {
     struct pa_classify_stream_def *next;
+    struct pa_classify_stream_def *bucket_next; /* next in index bucket */
+    uint32_t                       seq;   /* definition order */
                                           /* for stream classification */
     pa_policy_match_object        *stream_match;
     uid_t                          uid;   /* user id, if any */
@@ -54,15 +61,44 @@ struct pa_classify_stream_def {
     char                          *clnam; /* client name, if any */
     char                          *sname; /* active routing sink name, if any */
     uid_t                          sact;  /* routing sink active */
-    char                          *group; /* policy group name */
+    const char                    *group; /* policy group name (atom) */
+    struct pa_policy_group        *grp;   /* the group, once it exists */
     uint32_t                       flags; /* PA_POLICY_LOCAL_ROUTE |
                                              PA_POLICY_LOCAL_MUTE   */
     pa_proplist                   *properties;
 };
 
+/* Stream definitions are bucketed by their most selective exact-match
+ * key, so classification only needs to evaluate the definitions that
+ * could possibly match. Every definition lives in exactly one bucket
+ * and buckets are kept in definition order (seq). */
+struct pa_classify_stream_bucket {
+    struct pa_classify_stream_def *first;
+    struct pa_classify_stream_def *last;
+};
+
+struct pa_classify_stream_index {
+    uint32_t                          ndef;
+    struct pa_classify_stream_def    *tail;   /* last definition */
+    pa_hashmap                       *props;  /* prop name -> value -> bucket */
+    pa_hashmap                       *exes;   /* exe -> bucket */
+    pa_hashmap                       *clnams; /* client name -> bucket */
+    pa_hashmap                       *uids;   /* uid -> bucket */
+    struct pa_classify_stream_bucket  any;    /* no exact-match key */
+};
+
 struct pa_classify_stream {
     pa_hashmap                    *app_id_map;
     struct pa_classify_stream_def *defs;
+    struct pa_classify_stream_index index;
+};
+
+/* Cached stream classification result of a client. The group and the
+ * properties are borrowed from the stream definition or the app_id map. */
+struct pa_classify_cache_entry {
+    const char                    *group;
+    uint32_t                       flags;
+    pa_proplist                   *properties;
 };
 
 struct pa_classify_port_config_entry {
@@ -89,7 +125,8 @@ struct pa_classify_device_data {
 };
 
 struct pa_classify_device_def {
-    char                            *type;  /* device type, e.g. ihf */
+    const char                      *type;  /* device type atom, e.g. ihf */
+    int                              type_id; /* bit in classify results */
                                             /* for classification */
     pa_policy_match_object          *dev_match;
     struct pa_classify_device_data   data;  /* data associated with device */
@@ -107,7 +144,8 @@ struct pa_classify_card_data {
 };
 
 struct pa_classify_card_def {
-    char                        *type;    /* handled device name, e.g ihf */
+    const char                  *type;    /* handled device atom, e.g ihf */
+    int                          type_id; /* bit in classify results */
     struct pa_classify_card_data data[2]; /* data associated with device 'type' */
 };
 
@@ -130,13 +168,24 @@ struct pa_classify {
     struct pa_classify_card     *cards;
     struct pa_classify_module    module[PA_POLICY_MODULE_COUNT];
     pa_hook_slot                *module_unlink_hook_slot;
+    pa_idxset                   *stream_keys;  /* properties used by stream matching */
+    pa_hashmap                  *client_cache; /* client idx -> signature -> entry */
+    const char                  *types[PA_POLICY_CLASSIFY_TYPE_MAX]; /* type id -> atom */
+    int                          ntype;
 };
 
+/* Set of device/card types. Every configured type gets a bit when the
+ * configuration is loaded, so results live on the stack and can be
+ * combined with plain bit operations. */
 struct pa_classify_result {
-    uint32_t    count;
-    const char *types[1];
+    uint32_t    bits[PA_POLICY_CLASSIFY_TYPE_WORDS];
 };
 
+#define PA_CLASSIFY_RESULT_FOREACH(id, r)                               \
+    for ((id) = pa_classify_result_next((r), 0);                        \
+         (id) >= 0;                                                     \
+         (id) = pa_classify_result_next((r), (id) + 1))
+
 struct pa_classify *pa_classify_new(struct userdata *);
 void  pa_classify_free(struct userdata *u);
 void  pa_classify_add_sink(struct userdata *, const char *, const char *,
@@ -165,6 +214,9 @@ void  pa_classify_register_app_id(struct userdata *, const char *, const char *,
 void  pa_classify_unregister_app_id(struct userdata *, const char *, const char *,
                                  enum pa_classify_method, const char *);
 
+void  pa_classify_invalidate_client(struct userdata *, uint32_t);
+void  pa_classify_invalidate_clients(struct userdata *);
+
 const char *pa_classify_sink_input(struct userdata *u, struct pa_sink_input *sinp,
                                    uint32_t *flags);
 const char *pa_classify_sink_input_by_data(struct userdata *u,
@@ -175,18 +227,29 @@ const char *pa_classify_source_output_by_data(struct userdata *u,
                                         struct pa_source_output_new_data *data);
 
 int   pa_classify_sink(struct userdata *, struct pa_sink *,
-                       uint32_t, uint32_t, struct pa_classify_result **result);
+                       uint32_t, uint32_t, struct pa_classify_result *result);
 int   pa_classify_source(struct userdata *, struct pa_source *,
-                         uint32_t, uint32_t, struct pa_classify_result **result);
+                         uint32_t, uint32_t, struct pa_classify_result *result);
 int   pa_classify_card(struct userdata *, struct pa_card *,
-                       uint32_t, uint32_t, bool, struct pa_classify_result **result);
+                       uint32_t, uint32_t, bool, struct pa_classify_result *result);
 
 int   pa_classify_card_all_types(struct userdata *u,
-                                 struct pa_classify_result **result);
+                                 struct pa_classify_result *result);
 int   pa_classify_sink_all_types(struct userdata *u,
-                                 struct pa_classify_result **result);
+                                 struct pa_classify_result *result);
 int   pa_classify_source_all_types(struct userdata *u,
-                                   struct pa_classify_result **result);
+                                   struct pa_classify_result *result);
+
+void  pa_classify_result_clear(struct pa_classify_result *);
+void  pa_classify_result_add(struct pa_classify_result *, int type_id);
+void  pa_classify_result_union(struct pa_classify_result *, const struct pa_classify_result *);
+void  pa_classify_result_diff(struct pa_classify_result *, const struct pa_classify_result *);
+int   pa_classify_result_count(const struct pa_classify_result *);
+/* Returns the first type id >= type_id in the set, or -1 */
+int   pa_classify_result_next(const struct pa_classify_result *, int type_id);
+const char *pa_classify_type_name(struct userdata *, int type_id);
+/* Space separated type names for logging; free the string after use. */
+char *pa_classify_result_to_string(struct userdata *, const struct pa_classify_result *);
 
 int   pa_classify_is_sink_typeof(struct userdata *, struct pa_sink *,
                                  const char *,
@@ -215,13 +278,12 @@ void pa_classify_update_modules(struct userdata *u, uint32_t dir, const char *ty
 
 /* Get all device types that contain give port name.
  * Returns the number of device types containing the port,
- * If types is not NULL it will be filled with the device types.
- * Free the types pointer after use. */
+ * If types is not NULL it will be filled with the device types. */
 int pa_classify_port_get_device_types(struct userdata *u,
                                       pa_direction_t direction,
                                       const char *port_name,
                                       int flags,
-                                      struct pa_classify_result **p_types);
+                                      struct pa_classify_result *types);
 
 #endif
 
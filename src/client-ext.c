@@ -10,9 +10,12 @@
 #include <config.h>
 #endif
 #include <pulse/def.h>
+#include <pulse/rtclock.h>
+#include <pulsecore/core-util.h>
 
 #include "userdata.h"
 #include "client-ext.h"
+#include "classify.h"
 
 static void handle_client_events(pa_core *, pa_subscription_event_type_t,
 				 uint32_t, void *);
@@ -21,9 +24,18 @@ static void handle_new_or_modified_client(struct userdata  *,
                                           struct pa_client *);
 static void handle_removed_client(struct userdata *, uint32_t);
 
-static char *client_ext_dump(struct pa_client *, char *, int);
+static char *client_ext_dump(struct userdata *, struct pa_client *, char *, int);
 
-static void client_ext_set_arg0(struct pa_client *client);
+static struct pa_client_arg0_worker *arg0_worker_new(struct userdata *);
+static void arg0_worker_free(struct pa_client_arg0_worker *);
+static void arg0_request(struct userdata *, struct pa_client *);
+static void arg0_forget(struct pa_client_arg0_worker *, uint32_t);
+
+static void uid_cache_init(struct userdata *, struct pa_client_uid_cache *);
+static void uid_cache_free(struct pa_client_uid_cache *);
+static void uid_cache_refresh_cb(pa_mainloop_api *, pa_time_event *,
+                                 const struct timeval *, void *);
+static bool uid_cache_lookup(struct pa_client_uid_cache *, const char *, uid_t *);
 
 struct pa_client_evsubscr *pa_client_ext_subscription(struct userdata *u)
 {
@@ -40,6 +52,9 @@ struct pa_client_evsubscr *pa_client_ext_subscription(struct userdata *u)
     subscr = pa_xnew0(struct pa_client_evsubscr, 1);
     
     subscr->events = events;
+    subscr->arg0   = arg0_worker_new(u);
+
+    uid_cache_init(u, &subscr->uids);
     
     return subscr;
 }
@@ -48,6 +63,8 @@ void pa_client_ext_subscription_free(struct pa_client_evsubscr *subscr)
 {
     if (subscr != NULL) {
         pa_subscription_free(subscr->events);
+        uid_cache_free(&subscr->uids);
+        arg0_worker_free(subscr->arg0);
         
         pa_xfree(subscr);
     }
@@ -110,14 +127,15 @@ pid_t pa_client_ext_pid(struct pa_client *client)
     return pid;
 }
 
-uid_t pa_client_ext_uid(struct pa_client *client)
+uid_t pa_client_ext_uid(struct userdata *u, struct pa_client *client)
 {
     const char     *uidstr;
     bool            valid;
-    struct passwd  *pwd;
     uid_t           uid;
     char           *e;
 
+    assert(u);
+    assert(u->scl);
     assert(client);
 
     valid = false;
@@ -132,19 +150,8 @@ uid_t pa_client_ext_uid(struct pa_client *client)
      * [0] https://www.gnu.org/software/coreutils/manual/coreutils.html#Disambiguating-names-and-IDs */
 
     /* first try to interpret user id as string */
-    if (uidstr) {
-        setpwent();
-
-        while ((pwd = getpwent())) {
-            if (!strcmp(uidstr, pwd->pw_name)) {
-                uid = pwd->pw_uid;
-                valid = true;
-                break;
-            }
-        }
-
-        endpwent();
-    }
+    if (uidstr)
+        valid = uid_cache_lookup(&u->scl->uids, uidstr, &uid);
 
     /* if no user was found, interpret user id as number */
     if (!valid && uidstr) {
@@ -184,16 +191,18 @@ const char *pa_client_ext_args(struct pa_client *client)
 }
 
 
-const char *pa_client_ext_arg0(struct pa_client *client)
+const char *pa_client_ext_arg0(struct userdata *u, struct pa_client *client)
 {
     const char *arg0;
 
+    assert(u);
     assert(client);
 
     arg0 = pa_proplist_gets(client->proplist, PA_PROP_APPLICATION_PROCESS_ARG0);
     
+    /* the property is set once the worker has read the command line */
     if (arg0 == NULL)
-        client_ext_set_arg0(client);
+        arg0_request(u, client);
     
     return arg0;
 }
@@ -250,20 +259,265 @@ static void handle_new_or_modified_client(struct userdata  *u,
     char     buf[1024];
 
     pa_log_debug("new/modified client (idx=%d) %s", idx,
-                 client_ext_dump(client, buf, sizeof(buf)));
+                 client_ext_dump(u, client, buf, sizeof(buf)));
+
+    pa_classify_invalidate_client(u, idx);
 }
 
 static void handle_removed_client(struct userdata *u, uint32_t idx)
 {
     pa_log_debug("client removed (idx=%d)", idx);
+
+    pa_classify_invalidate_client(u, idx);
+
+    if (u->scl)
+        arg0_forget(u->scl->arg0, idx);
 }
 
 
-static void client_ext_set_arg0(struct pa_client *client)
+/*
+ * command line harvesting
+ *
+ * Reading /proc/<pid>/cmdline may block, so it is done by a worker
+ * thread. The worker keeps its own cache keyed by pid and process start
+ * time, so a process with several connections is read only once while a
+ * reused pid is detected by the changed start time. The main loop keeps
+ * track of the requested clients, so a busy client is never re-requested.
+ */
+
+#define ARG0_QUEUE_SIZE   32    /* in-flight requests; results get twice */
+#define ARG0_CACHE_MAX    256
+
+#define ARG0_PENDING      1
+#define ARG0_FAILED       2
+
+struct arg0_job {
+    uint32_t  client;           /* PA_IDXSET_INVALID to stop the worker */
+    pid_t     pid;
+    char     *arg0;             /* NULL if the command line can't be read */
+};
+
+static void arg0_job_free(void *data)
 {
-    char  path[256], arg0[1024];
-    int   fd, len;
-    pid_t pid;
+    struct arg0_job *job = data;
+
+    if (job) {
+        pa_xfree(job->arg0);
+        pa_xfree(job);
+    }
+}
+
+static int arg0_read_file(const char *path, char *buf, size_t size)
+{
+    int fd, len;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return -1;
+
+    for (;;) {
+        if ((len = read(fd, buf, size - 1)) < 0) {
+            if (errno == EINTR)
+                continue;
+            else
+                len = 0;
+        }
+
+        break;
+    }
+
+    buf[len] = '\0';
+
+    close(fd);
+
+    return len;
+}
+
+static int arg0_read_starttime(pid_t pid, unsigned long long *starttime)
+{
+    char  path[256], buf[1024];
+    char *p;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+
+    if (arg0_read_file(path, buf, sizeof(buf)) <= 0)
+        return -1;
+
+    /* the command name may contain spaces and parentheses */
+    if (!(p = strrchr(buf, ')')))
+        return -1;
+
+    if (sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u "
+                      "%*d %*d %*d %*d %*d %*d %llu", starttime) != 1)
+        return -1;
+
+    return 0;
+}
+
+static char *arg0_read_cmdline(pid_t pid)
+{
+    char path[256], arg0[1024];
+
+    snprintf(path, sizeof(path), "/proc/%d/cmdline", pid);
+
+    if (arg0_read_file(path, arg0, sizeof(arg0)) < 0) {
+        pa_log("can't obtain command line");
+        return NULL;
+    }
+
+    return pa_xstrdup(arg0);
+}
+
+static void arg0_worker_thread(void *userdata)
+{
+    struct pa_client_arg0_worker *w = userdata;
+    struct arg0_job    *job;
+    pa_hashmap         *cache;
+    unsigned long long  starttime;
+    const char         *arg0;
+    char                key[64];
+
+    cache = pa_hashmap_new_full(pa_idxset_string_hash_func,
+                                pa_idxset_string_compare_func,
+                                pa_xfree,
+                                pa_xfree);
+
+    while ((job = pa_asyncq_pop(w->requests, true))) {
+        if (job->client == PA_IDXSET_INVALID) {
+            arg0_job_free(job);
+            break;
+        }
+
+        if (arg0_read_starttime(job->pid, &starttime) == 0) {
+            snprintf(key, sizeof(key), "%d:%llu", job->pid, starttime);
+
+            if ((arg0 = pa_hashmap_get(cache, key)))
+                job->arg0 = pa_xstrdup(arg0);
+            else if ((job->arg0 = arg0_read_cmdline(job->pid))) {
+                if (pa_hashmap_size(cache) >= ARG0_CACHE_MAX)
+                    pa_hashmap_remove_all(cache);
+
+                pa_hashmap_put(cache, pa_xstrdup(key), pa_xstrdup(job->arg0));
+            }
+        }
+
+        /* can't block: there are never more jobs than queue slots */
+        pa_asyncq_push(w->results, job, true);
+    }
+
+    pa_hashmap_free(cache);
+}
+
+static void arg0_job_done(struct pa_client_arg0_worker *w, struct arg0_job *job)
+{
+    struct pa_client *client;
+    void             *key = PA_UINT32_TO_PTR(job->client);
+
+    w->npending--;
+
+    /* the client might have been removed meanwhile */
+    if (pa_hashmap_remove(w->clients, key)) {
+        client = pa_idxset_get_by_index(w->core->clients, job->client);
+
+        if (client && pa_client_ext_pid(client) == job->pid) {
+            if (job->arg0) {
+                pa_proplist_sets(client->proplist,
+                                 PA_PROP_APPLICATION_PROCESS_ARG0, job->arg0);
+            }
+            else {
+                pa_hashmap_put(w->clients, key, PA_UINT32_TO_PTR(ARG0_FAILED));
+            }
+        }
+    }
+
+    arg0_job_free(job);
+}
+
+static void arg0_results_cb(pa_mainloop_api *a, pa_io_event *e, int fd,
+                            pa_io_event_flags_t events, void *userdata)
+{
+    struct pa_client_arg0_worker *w = userdata;
+    struct arg0_job *job;
+
+    pa_assert(w);
+
+    pa_asyncq_read_after_poll(w->results);
+
+    for (;;) {
+        while ((job = pa_asyncq_pop(w->results, false)))
+            arg0_job_done(w, job);
+
+        if (pa_asyncq_read_before_poll(w->results) == 0)
+            break;
+    }
+}
+
+static struct pa_client_arg0_worker *arg0_worker_new(struct userdata *u)
+{
+    struct pa_client_arg0_worker *w;
+    pa_mainloop_api *mainloop;
+
+    pa_assert(u);
+    pa_assert(u->core);
+    pa_assert_se((mainloop = u->core->mainloop));
+
+    w = pa_xnew0(struct pa_client_arg0_worker, 1);
+
+    w->core     = u->core;
+    w->clients  = pa_hashmap_new(pa_idxset_trivial_hash_func,
+                                 pa_idxset_trivial_compare_func);
+    w->requests = pa_asyncq_new(ARG0_QUEUE_SIZE);
+    w->results  = pa_asyncq_new(ARG0_QUEUE_SIZE * 2);
+    w->io       = mainloop->io_new(mainloop, pa_asyncq_read_fd(w->results),
+                                   PA_IO_EVENT_INPUT, arg0_results_cb, w);
+
+    pa_asyncq_read_before_poll(w->results);
+
+    if (!(w->thread = pa_thread_new("policy-arg0", arg0_worker_thread, w)))
+        pa_log("failed to start command line reader thread");
+
+    return w;
+}
+
+static void arg0_worker_free(struct pa_client_arg0_worker *w)
+{
+    struct arg0_job *quit;
+
+    if (w == NULL)
+        return;
+
+    if (w->io)
+        w->core->mainloop->io_free(w->io);
+
+    if (w->thread) {
+        quit = pa_xnew0(struct arg0_job, 1);
+        quit->client = PA_IDXSET_INVALID;
+
+        pa_asyncq_push(w->requests, quit, true);
+        pa_thread_free(w->thread);
+    }
+
+    pa_asyncq_free(w->results, arg0_job_free);
+    pa_asyncq_free(w->requests, arg0_job_free);
+    pa_hashmap_free(w->clients);
+
+    pa_xfree(w);
+}
+
+static void arg0_request(struct userdata *u, struct pa_client *client)
+{
+    struct pa_client_arg0_worker *w;
+    struct arg0_job *job;
+    void  *key;
+    pid_t  pid;
+
+    if (!u->scl || !(w = u->scl->arg0) || !w->thread)
+        return;
+
+    key = PA_UINT32_TO_PTR(client->index);
+
+    /* already being read, or the command line couldn't be read */
+    if (pa_hashmap_get(w->clients, key))
+        return;
 
     if (!(pid = pa_client_ext_pid(client))) {
         /*
@@ -274,29 +528,154 @@ static void client_ext_set_arg0(struct pa_client *client)
         return;
     }
 
-    snprintf(path, sizeof(path), "/proc/%d/cmdline", pid);
-    if ((fd = open(path, O_RDONLY)) < 0) {
-        pa_log("can't obtain command line");
+    /* keep a slot free for stopping the worker; retry on the next call */
+    if (w->npending >= ARG0_QUEUE_SIZE - 1)
+        return;
+
+    job = pa_xnew0(struct arg0_job, 1);
+    job->client = client->index;
+    job->pid    = pid;
+
+    if (pa_asyncq_push(w->requests, job, false) < 0) {
+        arg0_job_free(job);
         return;
     }
 
-    for (;;) {
-        if ((len = read(fd, arg0, sizeof(arg0)-1)) < 0) {
-            if (errno == EINTR)
-                continue;
-            else {
-                arg0[0] = '\0';
-                break;
-            }
+    w->npending++;
+
+    pa_hashmap_put(w->clients, key, PA_UINT32_TO_PTR(ARG0_PENDING));
+}
+
+static void arg0_forget(struct pa_client_arg0_worker *w, uint32_t idx)
+{
+    if (w)
+        pa_hashmap_remove(w->clients, PA_UINT32_TO_PTR(idx));
+}
+
+#define UID_CACHE_PASSWD_PATH      "/etc/passwd"
+#define UID_CACHE_CHECK_INTERVAL   (10 * PA_USEC_PER_SEC)
+
+static void uid_cache_free(struct pa_client_uid_cache *cache)
+{
+    if (cache->refresh) {
+        cache->core->mainloop->time_free(cache->refresh);
+        cache->refresh = NULL;
+    }
+
+    if (cache->names) {
+        pa_hashmap_free(cache->names);
+        cache->names = NULL;
+    }
+}
+
+static void uid_cache_load(struct pa_client_uid_cache *cache)
+{
+    struct passwd *pwd;
+
+    if (cache->names)
+        pa_hashmap_free(cache->names);
+
+    cache->names = pa_hashmap_new_full(pa_idxset_string_hash_func,
+                                       pa_idxset_string_compare_func,
+                                       pa_xfree,
+                                       NULL);
+    setpwent();
+
+    while ((pwd = getpwent())) {
+        /* the first entry of a name wins, like with a linear scan */
+        if (!pa_hashmap_get(cache->names, pwd->pw_name)) {
+            pa_hashmap_put(cache->names, pa_xstrdup(pwd->pw_name),
+                           PA_UINT32_TO_PTR(pwd->pw_uid + 1));
         }
-        
-        arg0[len] = '\0';
-        break;
     }
 
-    close(fd);
+    endpwent();
+
+    pa_log_debug("loaded %u users to uid cache (hits %u, misses %u)",
+                 pa_hashmap_size(cache->names), cache->hits, cache->misses);
+}
+
+static time_t uid_cache_passwd_mtime(void)
+{
+    struct stat st;
+
+    if (stat(UID_CACHE_PASSWD_PATH, &st) < 0)
+        return 0;
+
+    return st.st_mtime;
+}
+
+static void uid_cache_init(struct userdata *u, struct pa_client_uid_cache *cache)
+{
+    cache->core  = u->core;
+    cache->mtime = uid_cache_passwd_mtime();
+
+    uid_cache_load(cache);
+
+    cache->refresh = pa_core_rttime_new(u->core,
+                                        pa_rtclock_now() + UID_CACHE_CHECK_INTERVAL,
+                                        uid_cache_refresh_cb, u);
+}
+
+static void uid_cache_publish_stats(struct userdata *u,
+                                    struct pa_client_uid_cache *cache)
+{
+    pa_proplist *proplist;
+    char         value[64];
+
+    /* the counters only grow, so their sum tells whether they changed */
+    if (cache->hits + cache->misses == cache->published)
+        return;
+
+    cache->published = cache->hits + cache->misses;
+
+    snprintf(value, sizeof(value), "hits=%u misses=%u",
+             cache->hits, cache->misses);
+
+    proplist = pa_proplist_new();
+    pa_proplist_sets(proplist, PA_PROP_POLICY_UID_CACHE_STATS, value);
+    pa_module_update_proplist(u->module, PA_UPDATE_REPLACE, proplist);
+    pa_proplist_free(proplist);
+}
+
+static void uid_cache_refresh_cb(pa_mainloop_api *m, pa_time_event *e,
+                                 const struct timeval *t, void *userdata)
+{
+    struct userdata            *u = userdata;
+    struct pa_client_uid_cache *cache;
+    time_t                      mtime;
+
+    pa_assert(u);
+    pa_assert(u->scl);
+
+    cache = &u->scl->uids;
+    mtime = uid_cache_passwd_mtime();
+
+    if (mtime != cache->mtime) {
+        cache->mtime = mtime;
+        uid_cache_load(cache);
+    }
+
+    uid_cache_publish_stats(u, cache);
+
+    pa_core_rttime_restart(u->core, e, pa_rtclock_now() + UID_CACHE_CHECK_INTERVAL);
+}
+
+static bool uid_cache_lookup(struct pa_client_uid_cache *cache,
+                             const char *name, uid_t *uid)
+{
+    void *value;
+
+    /* uids are stored off by one so that root is not a NULL pointer */
+    if ((value = pa_hashmap_get(cache->names, name))) {
+        cache->hits++;
+        *uid = PA_PTR_TO_UINT32(value) - 1;
+        return true;
+    }
+
+    cache->misses++;
 
-    pa_proplist_sets(client->proplist, PA_PROP_APPLICATION_PROCESS_ARG0, arg0);
+    return false;
 }
 
 
@@ -356,7 +735,8 @@ static void client_ext_set_args(struct pa_client *client)
 #endif
 
 
-static char *client_ext_dump(struct pa_client *client, char *buf, int len)
+static char *client_ext_dump(struct userdata *u, struct pa_client *client,
+                             char *buf, int len)
 {
     const char  *name;
     const char  *id;
@@ -371,10 +751,10 @@ static char *client_ext_dump(struct pa_client *client, char *buf, int len)
         name = pa_client_ext_name(client);
         id   = pa_client_ext_id(client);
         pid  = pa_client_ext_pid(client);
-        uid  = pa_client_ext_uid(client);
+        uid  = pa_client_ext_uid(u, client);
         exe  = pa_client_ext_exe(client);
         args = pa_client_ext_args(client);
-        arg0 = pa_client_ext_arg0(client);
+        arg0 = pa_client_ext_arg0(u, client);
 
         if (!name)  name = "<noname>";
         if ( !id )  id   = "<noid>";
@@ -6,13 +6,43 @@
 
 #include <pulsecore/client.h>
 #include <pulsecore/core-subscribe.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/asyncq.h>
 
 #include "userdata.h"
 
 struct pa_client;
 
+/* user name -> uid map, loaded from the passwd database when the module
+ * is loaded and reloaded from a timer when /etc/passwd is modified, so
+ * that stream classification never touches NSS */
+struct pa_client_uid_cache {
+    pa_core                 *core;
+    pa_hashmap              *names;
+    time_t                   mtime;
+    pa_time_event           *refresh;   /* periodic mtime check */
+    uint32_t                 hits;
+    uint32_t                 misses;
+    uint32_t                 published; /* hits + misses last published */
+};
+
+/* /proc/<pid>/cmdline is read by a worker thread; requests and results
+ * are passed through lock-free queues and the results are picked up by
+ * the main loop when the result queue becomes readable */
+struct pa_client_arg0_worker {
+    pa_core                 *core;
+    pa_thread               *thread;
+    pa_asyncq               *requests;
+    pa_asyncq               *results;
+    pa_io_event             *io;
+    pa_hashmap              *clients;   /* client idx -> request state */
+    uint32_t                 npending;
+};
+
 struct pa_client_evsubscr {
     pa_subscription         *events;
+    struct pa_client_uid_cache uids;
+    struct pa_client_arg0_worker *arg0;
 };
 
 struct pa_client_evsubscr *pa_client_ext_subscription(struct userdata *);
@@ -21,10 +51,10 @@ void   pa_client_ext_discover(struct userdata *);
 const char *pa_client_ext_name(struct pa_client *);
 const char *pa_client_ext_id(struct pa_client *);
 pid_t  pa_client_ext_pid(struct pa_client *);
-uid_t  pa_client_ext_uid(struct pa_client *);
+uid_t  pa_client_ext_uid(struct userdata *, struct pa_client *);
 const char *pa_client_ext_exe(struct pa_client *);
 const char *pa_client_ext_args(struct pa_client *);
-const char *pa_client_ext_arg0(struct pa_client *);
+const char *pa_client_ext_arg0(struct userdata *, struct pa_client *);
 const char *pa_client_ext_app_id(struct pa_client *);
 
 
@@ -13,6 +13,7 @@
 #include "source-output-ext.h"
 #include "variable.h"
 #include "match.h"
+#include "atom.h"
 
 static struct pa_policy_context_variable
             *add_variable(struct pa_policy_context *, const char *);
@@ -22,6 +23,24 @@ static void delete_variable(struct pa_policy_context *,
 static struct pa_policy_context_rule
             *add_rule(struct pa_policy_context_rule **,
                       enum pa_classify_method, const char *);
+static void  index_rules(struct pa_policy_context_variable *);
+static size_t changes_store_value(struct pa_policy_context_changes *,
+                                  const char *);
+static void  changes_add(struct pa_policy_context_changes *,
+                         union pa_policy_context_action *, size_t);
+static void  changes_coalesce(struct pa_policy_context_changes *);
+static const char *set_property_value(struct pa_policy_set_property *,
+                                      const char *);
+static void  override_key(char *, size_t, const char *, const char *);
+static bool  override_precedes(struct pa_policy_context *,
+                               struct pa_policy_override *,
+                               struct pa_policy_override *);
+static void  override_index_add(struct pa_policy_context *,
+                                struct pa_policy_override *, pa_card *);
+static void  override_index_remove(struct pa_policy_context *,
+                                   struct pa_policy_override *, pa_card *);
+static void  index_objects(struct pa_policy_context *);
+static void  free_object_index(struct pa_policy_context *);
 static void  delete_rule(struct pa_policy_context_rule **,
                          struct pa_policy_context_rule  *);
 
@@ -37,15 +56,18 @@ static int   value_setup(struct userdata *u, union pa_policy_value *,
 static void  value_cleanup(union pa_policy_value *);
 
 static void register_object(struct pa_policy_object *,
-                            enum pa_policy_object_type,
-                            const char *, void *, int);
+                            struct pa_policy_match_snapshot *,
+                            const char *, int);
 static void unregister_object(struct pa_policy_object *,
                               enum pa_policy_object_type, const char *,
                               void *, unsigned long, int);
 static const char *get_object_property(struct pa_policy_object *,const char *);
-static void set_object_property(struct pa_policy_object *,
+static void set_object_property(struct userdata *, struct pa_policy_object *,
                                 const char *, const char *);
-static void delete_object_property(struct pa_policy_object *, const char *);
+static void delete_object_property(struct userdata *, struct pa_policy_object *,
+                                   const char *);
+static void object_property_changed(struct userdata *, struct pa_policy_object *);
+static void fire_dirty_objects(struct userdata *);
 static pa_proplist *get_object_proplist(struct pa_policy_object *);
 static int object_assert(struct userdata *, struct pa_policy_object *);
 static const char *object_name(struct pa_policy_object *);
@@ -66,6 +88,9 @@ struct pa_policy_context *pa_policy_context_new(struct userdata *u)
 
     ctx = pa_xmalloc0(sizeof(*ctx));
 
+    ctx->varmap = pa_hashmap_new(pa_idxset_string_hash_func,
+                                 pa_idxset_string_compare_func);
+
     return ctx;
 }
 
@@ -79,62 +104,57 @@ void pa_policy_context_free(struct pa_policy_context *ctx)
         while (ctx->activities != NULL)
             delete_activity(ctx, ctx->activities);
 
-        pa_xfree(ctx);
-    }
-}
+        if (ctx->varmap)
+            pa_hashmap_free(ctx->varmap);
 
-static void register_rule(struct pa_policy_context_rule *rule,
-                          enum pa_policy_object_type type,
-                          const char *name, void *ptr) {
-    union  pa_policy_context_action    *actn;
-    struct pa_policy_set_property      *setprop;
-    struct pa_policy_del_property      *delprop;
-    struct pa_policy_override          *overr;
-    struct pa_policy_object            *object;
-    int                                 lineno;
+        free_object_index(ctx);
 
-    for (actn = rule->actions;  actn != NULL;  actn = actn->any.next) {
+        pa_xfree(ctx->changes.entries);
+        pa_xfree(ctx->changes.arena);
 
-        switch (actn->any.type) {
+        if (ctx->activity_sinks)
+            pa_hashmap_free(ctx->activity_sinks);
 
-        case pa_policy_set_property:
-            setprop = &actn->setprop;
-            lineno  = setprop->lineno;
-            object  = &setprop->object;
-            break;
+        if (ctx->active_overrides)
+            pa_hashmap_free(ctx->active_overrides);
 
-        case pa_policy_delete_property:
-            delprop = &actn->delprop;
-            lineno  = delprop->lineno;
-            object  = &delprop->object;
-            break;
+        pa_xfree(ctx);
+    }
+}
 
-        case pa_policy_override:
-            overr   = &actn->overr;
-            lineno  = overr->lineno;
-            object  = &overr->object;
-            break;
+static struct pa_policy_object *action_object(union pa_policy_context_action *actn,
+                                              int *lineno)
+{
+    switch (actn->any.type) {
 
-        default:
-            continue;
-        } /* switch */
+    case pa_policy_set_property:
+        *lineno = actn->setprop.lineno;
+        return &actn->setprop.object;
 
-        register_object(object, type, name, ptr, lineno);
+    case pa_policy_delete_property:
+        *lineno = actn->delprop.lineno;
+        return &actn->delprop.object;
 
-    }  /* for actn */
+    case pa_policy_override:
+        *lineno = actn->overr.lineno;
+        return &actn->overr.object;
+
+    default:
+        return NULL;
+    } /* switch */
 }
 
-void pa_policy_context_register(struct userdata *u,
-                                enum pa_policy_object_type what,
-                                const char *name, void *ptr)
-{
-    struct pa_policy_context_variable *var;
-    struct pa_policy_context_rule     *rule;
+static void register_rule(struct pa_policy_context_rule *rule,
+                          struct pa_policy_match_snapshot *snap,
+                          const char *name) {
+    union  pa_policy_context_action    *actn;
+    struct pa_policy_object            *object;
+    int                                 lineno;
 
-    for (var = u->context->variables;   var != NULL;   var = var->next) {
-        for (rule = var->rules;   rule != NULL;   rule = rule->next)
-            register_rule(rule, what, name, ptr);
-    }  /*  for var */
+    for (actn = rule->actions;  actn != NULL;  actn = actn->any.next) {
+        if ((object = action_object(actn, &lineno)) != NULL)
+            register_object(object, snap, name, lineno);
+    }  /* for actn */
 }
 
 static void unregister_rule(struct pa_policy_context_rule *rule,
@@ -144,41 +164,40 @@ static void unregister_rule(struct pa_policy_context_rule *rule,
                             unsigned long index)
 {
     union  pa_policy_context_action    *actn;
-    struct pa_policy_set_property      *setprop;
-    struct pa_policy_del_property      *delprop;
-    struct pa_policy_override          *overr;
     struct pa_policy_object            *object;
     int                                 lineno;
 
     for (actn = rule->actions;  actn != NULL;  actn = actn->any.next) {
+        if ((object = action_object(actn, &lineno)) != NULL)
+            unregister_object(object, type, name, ptr, index, lineno);
+    } /* for actn */
+}
 
-        switch (actn->any.type) {
+void pa_policy_context_register(struct userdata *u,
+                                enum pa_policy_object_type what,
+                                const char *name, void *ptr)
+{
+    struct pa_policy_object_index     *oi;
+    struct pa_policy_object_ref       *ref;
+    struct pa_policy_match_snapshot    snap;
+    const char                        *objname;
 
-        case pa_policy_set_property:
-            setprop = &actn->setprop;
-            lineno  = setprop->lineno;
-            object  = &setprop->object;
-            break;
+    if (what <= pa_policy_object_min || what >= pa_policy_object_max)
+        return;
 
-        case pa_policy_delete_property:
-            delprop = &actn->delprop;
-            lineno  = delprop->lineno;
-            object  = &delprop->object;
-            break;
+    oi = &u->context->objects[what];
 
-        case pa_policy_override:
-            overr   = &actn->overr;
-            lineno  = overr->lineno;
-            object  = &overr->object;
-            break;
+    pa_policy_match_snapshot_init(&snap, u->match_keys, what, ptr);
 
-        default:
-            continue;
-        } /* switch */
+    if (oi->names && (objname = pa_policy_match_object_name(what, ptr))) {
+        for (ref = pa_hashmap_get(oi->names, objname);  ref;  ref = ref->name_next)
+            register_object(ref->object, &snap, name, ref->lineno);
+    }
 
-        unregister_object(object, type, name, ptr, index, lineno);
+    for (ref = oi->other;  ref != NULL;  ref = ref->name_next)
+        register_object(ref->object, &snap, name, ref->lineno);
 
-    } /* for actn */
+    pa_policy_match_snapshot_done(&snap);
 }
 
 void pa_policy_context_unregister(struct userdata *u,
@@ -187,13 +206,14 @@ void pa_policy_context_unregister(struct userdata *u,
                                   void *ptr,
                                   unsigned long index)
 {
-    struct pa_policy_context_variable *var;
-    struct pa_policy_context_rule     *rule;
+    struct pa_policy_object_ref *ref;
 
-    for (var = u->context->variables;   var != NULL;   var = var->next) {
-        for (rule = var->rules;   rule != NULL;   rule = rule->next)
-            unregister_rule(rule, type, name, ptr, index);
-    }  /* for var */
+    if (type <= pa_policy_object_min || type >= pa_policy_object_max)
+        return;
+
+    /* the name of the object may have changed since it was registered */
+    for (ref = u->context->objects[type].all;  ref;  ref = ref->next)
+        unregister_object(ref->object, type, name, ptr, index, ref->lineno);
 }
 
 struct pa_policy_context_rule *
@@ -357,37 +377,44 @@ int pa_context_override_card_profile(struct userdata *u,
                                      const char *pn,
                                      const char **override_pn)
 {
-    union pa_policy_context_action     *actn;
     struct pa_policy_override          *overr;
-    struct pa_policy_object            *object;
-    pa_card                            *actn_card;
     const char                         *profile;
+    char                                key[256];
 
     pa_assert(override_pn);
 
-    for (actn = u->context->overrides; actn; actn = actn->any.next)
-    {
-        pa_assert(actn->any.type == pa_policy_override);
+    if (!u->context->active_overrides)
+        return 0;
 
-        overr   = &actn->overr;
-        object  = &overr->object;
+    override_key(key, sizeof(key), card->name, pn);
 
-        if (!overr->active)
-            continue;
+    if (!(overr = pa_hashmap_get(u->context->active_overrides, key)))
+        return 0;
 
-        pa_assert(object->type == pa_policy_object_card);
-        pa_assert_se((actn_card = (pa_card *) object->ptr));
+    pa_assert(overr->active);
 
-        if (card == actn_card && !strcmp(overr->orig_profile, pn)) {
-            profile = overr->value.constant.string;
-            pa_log_debug("override: override card %s port %s to %s",
-                         card->name, pn, profile);
-            pa_assert_se((*override_pn = profile));
-            return 1;
-        }
-    }
+    if (overr->object.ptr != card)
+        return 0;
 
-    return 0;
+    profile = overr->value.constant.string;
+    pa_log_debug("override: override card %s port %s to %s",
+                 card->name, pn, profile);
+    pa_assert_se((*override_pn = profile));
+
+    return 1;
+}
+
+void pa_policy_context_build_index(struct userdata *u)
+{
+    struct pa_policy_context_variable *var;
+
+    pa_assert(u);
+    pa_assert(u->context);
+
+    for (var = u->context->variables;  var != NULL;  var = var->next)
+        index_rules(var);
+
+    index_objects(u->context);
 }
 
 int pa_policy_context_variable_changed(struct userdata *u, const char *name,
@@ -396,62 +423,196 @@ int pa_policy_context_variable_changed(struct userdata *u, const char *name,
     struct pa_policy_context_variable *var;
     struct pa_policy_context_rule     *rule;
     union pa_policy_context_action    *actn;
+    struct pa_policy_context_rule_chain *eq;
+    struct pa_policy_context_rule     *eqrule;
+    struct pa_policy_context_rule     *other;
+    size_t                             offs;
     int                                success;
 
     success = true;
+    offs    = (size_t) -1;
 
-    for (var = u->context->variables;  var != NULL;  var = var->next) {
-        if (!strcmp(name, var->name)) {
-            if (!strcmp(value, var->value))
-                pa_log_debug("no value change -> no action");
-            else {
-                pa_xfree(var->value);
-                var->value = pa_xstrdup(value);
-
-                for (rule = var->rules;  rule != NULL;  rule = rule->next) {
-                    if (pa_policy_match(rule->match, value)) {
-                        for (actn = rule->actions; actn; actn = actn->any.next)
-                        {
-                            if (u->context->variable_change_count == PA_POLICY_CONTEXT_MAX_CHANGES) {
-                                pa_log_warn("Max policy context value changes, dropping '%s':'%s'", name, value);
-                                return false;
-                            } else {
-                                u->context->variable_change[u->context->variable_change_count].action = actn;
-                                u->context->variable_change[u->context->variable_change_count].value = pa_xstrdup(value);
-                                u->context->variable_change_count++;
-                            }
-                        } /* for actn */
-                    } /* if rule */
-                } /* for rule */
-            }
-            
-            break;
+    if ((var = pa_hashmap_get(u->context->varmap, name)) == NULL)
+        return success;
+
+    if (!strcmp(value, var->value)) {
+        pa_log_debug("no value change -> no action");
+        return success;
+    }
+
+    pa_xfree(var->value);
+    var->value = pa_xstrdup(value);
+
+    eq     = pa_hashmap_get(var->equals, value);
+    eqrule = eq ? eq->first : NULL;
+    other  = var->other.first;
+
+    /* merge the two chains to keep the rules in definition order; the
+       'equals' rules of the value match without evaluation */
+    while (eqrule || other) {
+        if (!other || (eqrule && eqrule->seq < other->seq)) {
+            rule   = eqrule;
+            eqrule = eqrule->value_next;
         }
-    } /* for var */
+        else {
+            rule  = other;
+            other = other->value_next;
+
+            if (!pa_policy_match(rule->match, value))
+                continue;
+        }
+
+        for (actn = rule->actions; actn; actn = actn->any.next) {
+            if (offs == (size_t) -1)
+                offs = changes_store_value(&u->context->changes, value);
+
+            changes_add(&u->context->changes, actn, offs);
+        } /* for actn */
+    } /* for rule */
 
     return success;
 }
 
 void pa_policy_context_variable_commit(struct userdata *u)
 {
-    union pa_policy_context_action *action;
-    char *value;
+    struct pa_policy_context_changes *changes;
+    struct pa_policy_context_change  *change;
+    union pa_policy_context_action   *action;
+    char                             *value;
+    const char                       *prop_value;
+    size_t                            i;
 
     pa_assert(u);
     pa_assert(u->context);
 
-    while (u->context->variable_change_count) {
-        u->context->variable_change_count--;
+    changes = &u->context->changes;
+
+    changes_coalesce(changes);
 
-        action = u->context->variable_change[u->context->variable_change_count].action;
-        value  = u->context->variable_change[u->context->variable_change_count].value;
+    if (changes->count > 0) {
+        u->context->dirty = pa_hashmap_new_full(pa_idxset_trivial_hash_func,
+                                                pa_idxset_trivial_compare_func,
+                                                NULL, pa_xfree);
+    }
+
+    /* changes are performed in the reverse order of collection */
+    for (i = changes->count;  i > 0;  i--) {
+        change = changes->entries + (i - 1);
+        action = change->action;
+        value  = changes->arena + change->value;
+
+        if (change->skip) {
+            /* the property is written by a later action but the
+               shared string is still forwarded in order */
+            if (action->any.type == pa_policy_set_property &&
+                (prop_value = set_property_value(&action->setprop, value)))
+                pa_shared_data_sets(u->shared, action->setprop.property,
+                                    prop_value);
+            continue;
+        }
 
         if (!perform_action(u, action, value))
             pa_log("Failed to perform action for value %s", value);
-        pa_xfree(value);
     }
+
+    fire_dirty_objects(u);
+
+    changes->count = 0;
+    changes->used  = 0;
+}
+
+static size_t changes_store_value(struct pa_policy_context_changes *changes,
+                                  const char *value)
+{
+    size_t len  = strlen(value) + 1;
+    size_t offs = changes->used;
+
+    if (changes->used + len > changes->length) {
+        changes->length = PA_MAX(changes->length * 2, changes->used + len);
+        changes->arena  = pa_xrealloc(changes->arena, changes->length);
+    }
+
+    memcpy(changes->arena + offs, value, len);
+    changes->used += len;
+
+    return offs;
+}
+
+static void changes_add(struct pa_policy_context_changes *changes,
+                        union pa_policy_context_action *action, size_t value)
+{
+    struct pa_policy_context_change *change;
+
+    if (changes->count == changes->size) {
+        changes->size    = changes->size ? changes->size * 2 : 16;
+        changes->entries = pa_xrealloc(changes->entries,
+                                       changes->size * sizeof(*change));
+    }
+
+    change = changes->entries + changes->count++;
+
+    change->action = action;
+    change->value  = value;
+    change->skip   = false;
 }
 
+/*
+ * Mark the property writes that a later write to the same property of
+ * the same object overrides. As changes are performed in reverse order,
+ * the write performed last is the one collected first.
+ */
+static void changes_coalesce(struct pa_policy_context_changes *changes)
+{
+    struct pa_policy_context_change *change;
+    union pa_policy_context_action  *action;
+    struct pa_policy_object         *object;
+    const char                      *property;
+    pa_hashmap                      *written;
+    char                            *key;
+    size_t                           i;
+
+    if (changes->count < 2)
+        return;
+
+    written = pa_hashmap_new_full(pa_idxset_string_hash_func,
+                                  pa_idxset_string_compare_func,
+                                  pa_xfree, NULL);
+
+    for (i = 0;  i < changes->count;  i++) {
+        change = changes->entries + i;
+        action = change->action;
+
+        switch (action->any.type) {
+        case pa_policy_set_property:
+            object   = &action->setprop.object;
+            property = action->setprop.property;
+            break;
+        case pa_policy_delete_property:
+            object   = &action->delprop.object;
+            property = action->delprop.property;
+            break;
+        default:
+            continue;
+        }
+
+        if (!object->ptr)
+            continue;
+
+        key = pa_sprintf_malloc("%d:%p:%s", object->type, object->ptr, property);
+
+        if (pa_hashmap_get(written, key)) {
+            change->skip = true;
+            pa_xfree(key);
+        }
+        else
+            pa_hashmap_put(written, key, change);
+    }
+
+    pa_hashmap_free(written);
+}
+
+
+
 static
 struct pa_policy_context_variable *add_variable(struct pa_policy_context *ctx,
                                                 const char *name)
@@ -478,6 +639,8 @@ struct pa_policy_context_variable *add_variable(struct pa_policy_context *ctx,
 
     last->next = var;
 
+    pa_hashmap_put(ctx->varmap, var->name, var);
+
     pa_log_debug("created context variable '%s'", var->name);
 
     return var;
@@ -495,8 +658,6 @@ static void delete_activity(struct pa_policy_context           *ctx,
         if (last->next == variable) {
             last->next = variable->next;
 
-            pa_xfree(variable->device);
-
             while (variable->active_rules != NULL)
                 delete_rule(&variable->active_rules, variable->active_rules);
             while (variable->inactive_rules != NULL)
@@ -527,6 +688,11 @@ static void delete_variable(struct pa_policy_context          *ctx,
             pa_log_debug("delete context variable '%s'", variable->name);
 #endif
 
+            pa_hashmap_remove(ctx->varmap, variable->name);
+
+            if (variable->equals)
+                pa_hashmap_free(variable->equals);
+
             pa_xfree(variable->name);
 
             while (variable->rules != NULL)
@@ -566,6 +732,143 @@ add_rule(struct pa_policy_context_rule    **rules,
     return rule;
 }
 
+static void index_rules(struct pa_policy_context_variable *var)
+{
+    struct pa_policy_context_rule_chain *chain;
+    struct pa_policy_context_rule       *rule;
+    const char                          *arg;
+
+    if (var->equals)
+        pa_hashmap_free(var->equals);
+
+    var->equals = pa_hashmap_new_full(pa_idxset_string_hash_func,
+                                      pa_idxset_string_compare_func,
+                                      pa_xfree, pa_xfree);
+    var->nrule  = 0;
+    var->other.first = var->other.last = NULL;
+
+    for (rule = var->rules;  rule != NULL;  rule = rule->next) {
+        rule->seq        = var->nrule++;
+        rule->value_next = NULL;
+
+        arg = pa_policy_match_arg(rule->match);
+
+        if (pa_policy_match_method(rule->match) == pa_method_equals && arg) {
+            if ((chain = pa_hashmap_get(var->equals, arg)) == NULL) {
+                chain = pa_xnew0(struct pa_policy_context_rule_chain, 1);
+                pa_hashmap_put(var->equals, pa_xstrdup(arg), chain);
+            }
+        }
+        else
+            chain = &var->other;
+
+        if (chain->last)
+            chain->last->value_next = rule;
+        else
+            chain->first = rule;
+
+        chain->last = rule;
+    }
+}
+
+static void index_objects(struct pa_policy_context *ctx)
+{
+    struct pa_policy_object_ref     *tail[pa_policy_object_max];
+    struct pa_policy_object_ref     *otail[pa_policy_object_max];
+    struct pa_policy_context_variable *var;
+    struct pa_policy_context_rule   *rule;
+    union pa_policy_context_action  *actn;
+    struct pa_policy_object_index   *oi;
+    struct pa_policy_object_ref     *ref;
+    struct pa_policy_object_ref     *last;
+    struct pa_policy_object         *object;
+    pa_policy_match_object          *match;
+    const char                      *objname;
+    int                              type;
+    int                              lineno;
+
+    free_object_index(ctx);
+
+    memset(tail, 0, sizeof(tail));
+    memset(otail, 0, sizeof(otail));
+
+    for (var = ctx->variables;  var != NULL;  var = var->next) {
+        for (rule = var->rules;  rule != NULL;  rule = rule->next) {
+            for (actn = rule->actions;  actn;  actn = actn->any.next) {
+                if (!(object = action_object(actn, &lineno)) ||
+                    !(match = object->match))
+                    continue;
+
+                /* the match type decides what the action can bind to */
+                type = match->type;
+
+                if (type <= pa_policy_object_min || type >= pa_policy_object_max)
+                    continue;
+
+                oi  = &ctx->objects[type];
+                ref = pa_xnew0(struct pa_policy_object_ref, 1);
+
+                ref->object = object;
+                ref->lineno = lineno;
+
+                if (tail[type])
+                    tail[type]->next = ref;
+                else
+                    oi->all = ref;
+                tail[type] = ref;
+
+                objname = pa_policy_match_arg(match);
+
+                if (match->target == pa_object_name && objname &&
+                    pa_policy_match_method(match) == pa_method_equals)
+                {
+                    if (!oi->names) {
+                        oi->names = pa_hashmap_new(pa_idxset_string_hash_func,
+                                                   pa_idxset_string_compare_func);
+                    }
+
+                    if (!(last = pa_hashmap_get(oi->names, objname)))
+                        pa_hashmap_put(oi->names, (void *) objname, ref);
+                    else {
+                        while (last->name_next)
+                            last = last->name_next;
+                        last->name_next = ref;
+                    }
+                }
+                else {
+                    if (otail[type])
+                        otail[type]->name_next = ref;
+                    else
+                        oi->other = ref;
+                    otail[type] = ref;
+                }
+            }
+        }
+    }
+}
+
+static void free_object_index(struct pa_policy_context *ctx)
+{
+    struct pa_policy_object_index *oi;
+    struct pa_policy_object_ref   *ref;
+    int                            type;
+
+    for (type = 0;  type < pa_policy_object_max;  type++) {
+        oi = &ctx->objects[type];
+
+        while ((ref = oi->all) != NULL) {
+            oi->all = ref->next;
+            pa_xfree(ref);
+        }
+
+        if (oi->names)
+            pa_hashmap_free(oi->names);
+
+        oi->names = NULL;
+        oi->other = NULL;
+    }
+}
+
 static void delete_rule(struct pa_policy_context_rule **rules,
                         struct pa_policy_context_rule  *rule)
 {
@@ -661,6 +964,103 @@ static void delete_action(union pa_policy_context_action **actions,
            __FUNCTION__);
 }
 
+static void override_key(char *key, size_t size, const char *card_name,
+                         const char *profile)
+{
+    snprintf(key, size, "%s:%s", card_name, profile);
+}
+
+static bool override_precedes(struct pa_policy_context *ctx,
+                              struct pa_policy_override *overr,
+                              struct pa_policy_override *other)
+{
+    union pa_policy_context_action *actn;
+
+    for (actn = ctx->overrides;  actn;  actn = actn->any.next) {
+        if (&actn->overr == overr)
+            return true;
+        if (&actn->overr == other)
+            return false;
+    }
+
+    return false;
+}
+
+/* Active overrides are indexed by the card and the profile they replace.
+ * The card name is used instead of the index, as an override stays
+ * active while its card is unplugged and gets rebound to the card when
+ * it comes back with a new index. */
+static void override_index_add(struct pa_policy_context *ctx,
+                               struct pa_policy_override *overr,
+                               pa_card *card)
+{
+    struct pa_policy_override *other;
+    char                       key[256];
+
+    if (!ctx->active_overrides) {
+        ctx->active_overrides = pa_hashmap_new_full(pa_idxset_string_hash_func,
+                                                    pa_idxset_string_compare_func,
+                                                    pa_xfree, NULL);
+    }
+
+    override_key(key, sizeof(key), card->name, overr->orig_profile);
+
+    /* the first active override of the list wins */
+    if (!(other = pa_hashmap_get(ctx->active_overrides, key)))
+        pa_hashmap_put(ctx->active_overrides, pa_xstrdup(key), overr);
+    else if (other != overr && override_precedes(ctx, overr, other)) {
+        pa_hashmap_remove_and_free(ctx->active_overrides, key);
+        pa_hashmap_put(ctx->active_overrides, pa_xstrdup(key), overr);
+    }
+}
+
+static void override_index_remove(struct pa_policy_context *ctx,
+                                  struct pa_policy_override *overr,
+                                  pa_card *card)
+{
+    union pa_policy_context_action *actn;
+    struct pa_policy_override      *other;
+    char                            key[256];
+
+    if (!ctx->active_overrides || !overr->orig_profile)
+        return;
+
+    override_key(key, sizeof(key), card->name, overr->orig_profile);
+
+    if (pa_hashmap_get(ctx->active_overrides, key) != overr)
+        return;
+
+    pa_hashmap_remove_and_free(ctx->active_overrides, key);
+
+    /* another active override of the same profile takes over */
+    for (actn = ctx->overrides;  actn;  actn = actn->any.next) {
+        other = &actn->overr;
+
+        if (other != overr && other->active && other->object.ptr == card &&
+            other->orig_profile && !strcmp(other->orig_profile, overr->orig_profile))
+        {
+            pa_hashmap_put(ctx->active_overrides, pa_xstrdup(key), other);
+            break;
+        }
+    }
+}
+
+static const char *set_property_value(struct pa_policy_set_property *setprop,
+                                      const char                    *var_value)
+{
+    switch (setprop->value.type) {
+
+    case pa_policy_value_constant:
+        return setprop->value.constant.string;
+
+    case pa_policy_value_copy:
+        return var_value;
+
+    default:
+        return NULL;
+    }
+}
+
 static int perform_action(struct userdata                *u,
                           union pa_policy_context_action *action,
                           char                           *var_value)
@@ -711,6 +1111,7 @@ static int perform_action(struct userdata                *u,
                     } else {
                         overr->active = 1;
                         success = true;
+                        override_index_add(u->context, overr, card);
                     }
                 }
             } else {
@@ -726,6 +1127,7 @@ static int perform_action(struct userdata                *u,
                 if (strcmp(card->active_profile->name, overr->value.constant.string) &&
                     strcmp(card->active_profile->name, profile_value)) {
 
+                    override_index_remove(u->context, overr, card);
                     overr->active = 0;
                     success = true;
                     pa_xfree(overr->orig_profile);
@@ -739,6 +1141,7 @@ static int perform_action(struct userdata                *u,
                     if (pa_card_set_profile(card, card_profile, false) < 0) {
                         pa_log("failed to set card profile");
                     } else {
+                        override_index_remove(u->context, overr, card);
                         overr->active = 0;
                         success = true;
                         pa_xfree(overr->orig_profile);
@@ -756,21 +1159,8 @@ static int perform_action(struct userdata                *u,
         if (!object_assert(u, object))
             success = false;
         else {
-            switch (setprop->value.type) {
+            prop_value = set_property_value(setprop, var_value);
 
-            case pa_policy_value_constant:
-                prop_value = setprop->value.constant.string;
-                break;
-
-            case pa_policy_value_copy:
-                prop_value = var_value;
-                break;
-                
-            default:
-                prop_value = NULL;
-                break;
-            }
-            
             if (prop_value == NULL)
                 success = false;
             else {
@@ -790,7 +1180,7 @@ static int perform_action(struct userdata                *u,
                                  objtype, objname, setprop->property,
                                  prop_value);
 
-                    set_object_property(object, setprop->property, prop_value);
+                    set_object_property(u, object, setprop->property, prop_value);
                 }
 
                 /* Forward shared strings */
@@ -814,7 +1204,7 @@ static int perform_action(struct userdata                *u,
             pa_log_debug("deleting %s '%s' property '%s'",
                          objtype, objname, delprop->property);
             
-            delete_object_property(object, delprop->property);
+            delete_object_property(u, object, delprop->property);
         }
         break;
 
@@ -892,12 +1282,14 @@ static void value_cleanup(union pa_policy_value *value)
 }
 
 static void register_object(struct pa_policy_object *object,
-                            enum pa_policy_object_type type,
-                            const char *name, void *ptr, int lineno)
+                            struct pa_policy_match_snapshot *snap,
+                            const char *name, int lineno)
 {
+    enum pa_policy_object_type type = snap->type;
+    void          *ptr = (void *) snap->target;
     const char    *type_str;
 
-    if (pa_policy_match_type(object->match, type, ptr)) {
+    if (pa_policy_match_snapshot_type(object->match, snap)) {
 
         type_str = pa_policy_object_type_str(type);
 
@@ -955,7 +1347,8 @@ static const char *get_object_property(struct pa_policy_object *object,
     return value;
 }
 
-static void set_object_property(struct pa_policy_object *object,
+static void set_object_property(struct userdata *u,
+                                struct pa_policy_object *object,
                                 const char *property, const char *value)
 {
     pa_proplist *proplist;
@@ -963,12 +1356,13 @@ static void set_object_property(struct pa_policy_object *object,
     if (object->ptr != NULL) {
         if ((proplist = get_object_proplist(object)) != NULL) {
             pa_proplist_sets(proplist, property, value);
-            fire_object_property_changed_hook(object);
+            object_property_changed(u, object);
         }
     }
 }
 
-static void delete_object_property(struct pa_policy_object *object,
+static void delete_object_property(struct userdata *u,
+                                   struct pa_policy_object *object,
                                    const char *property)
 {
     pa_proplist *proplist;
@@ -976,11 +1370,64 @@ static void delete_object_property(struct pa_policy_object *object,
     if (object->ptr != NULL) {
         if ((proplist = get_object_proplist(object)) != NULL) {
             pa_proplist_unset(proplist, property);
-            fire_object_property_changed_hook(object);
+            object_property_changed(u, object);
         }
     }
 }
 
+/* During a commit the proplist-changed hook of an object is fired once,
+ * after all the changes; otherwise right away. */
+static void object_property_changed(struct userdata *u,
+                                    struct pa_policy_object *object)
+{
+    struct pa_policy_object *dirty;
+
+    if (u->context->dirty == NULL) {
+        fire_object_property_changed_hook(object);
+        return;
+    }
+
+    if (pa_hashmap_get(u->context->dirty, object->ptr) == NULL) {
+        dirty = pa_xnew0(struct pa_policy_object, 1);
+        dirty->type  = object->type;
+        dirty->ptr   = object->ptr;
+        dirty->index = object->index;
+
+        pa_hashmap_put(u->context->dirty, dirty->ptr, dirty);
+    }
+}
+
+static void fire_dirty_objects(struct userdata *u)
+{
+    pa_hashmap              *dirty;
+    struct pa_policy_object *object;
+    pa_idxset               *idxset;
+    void                    *state;
+
+    if ((dirty = u->context->dirty) == NULL)
+        return;
+
+    u->context->dirty = NULL;
+
+    /* objects are fired in the order they were first changed */
+    PA_HASHMAP_FOREACH(object, dirty, state) {
+        switch (object->type) {
+        case pa_policy_object_sink:          idxset = u->core->sinks;          break;
+        case pa_policy_object_source:        idxset = u->core->sources;        break;
+        case pa_policy_object_sink_input:    idxset = u->core->sink_inputs;    break;
+        case pa_policy_object_source_output: idxset = u->core->source_outputs; break;
+        case pa_policy_object_module:        idxset = u->core->modules;        break;
+        default:                             idxset = NULL;                    break;
+        }
+
+        /* the object may have gone away during the commit */
+        if (idxset && pa_idxset_get_by_index(idxset, object->index) == object->ptr)
+            fire_object_property_changed_hook(object);
+    }
+
+    pa_hashmap_free(dirty);
+}
+
 static pa_proplist *get_object_proplist(struct pa_policy_object *object)
 {
     pa_proplist *proplist;
@@ -1172,13 +1619,15 @@ struct pa_policy_activity_variable *get_activity_variable(struct userdata *u, st
     struct pa_policy_activity_variable *var;
     struct pa_policy_activity_variable *last;
 
+    device = pa_policy_atom(u->atoms, device);
+
     for (last = (struct pa_policy_activity_variable *)&ctx->activities;
          last->next != NULL;
          last = last->next)
     {
         var = last->next;
 
-        if (!strcmp(device, var->device)) {
+        if (device == var->device) {
             pa_log_debug("updated context activity variable '%s'", var->device);
             return var;
         }
@@ -1186,7 +1635,7 @@ struct pa_policy_activity_variable *get_activity_variable(struct userdata *u, st
 
     var = pa_xmalloc0(sizeof(*var));
 
-    var->device = pa_xstrdup(device);
+    var->device = device;
     var->userdata = u;
     var->default_state = -1;
 
@@ -1233,57 +1682,139 @@ pa_policy_activity_add_inactive_rule(struct userdata *u, const char *device,
     return rule;
 }
 
+static int activity_state(pa_sink *sink, int force_state)
+{
+    if ((force_state != -1 && force_state == 1) ||
+        (force_state == -1 && PA_SINK_IS_OPENED(sink->state)))
+        return 1;
+
+    return 0;
+}
+
+/* Returns false if the actions for the state were already executed. */
+static bool run_activity_rule(struct pa_policy_activity_variable *var,
+                              struct pa_policy_context_rule *rule,
+                              int is_opened, int force_state)
+{
+    union pa_policy_context_action    *actn;
+
+    if (force_state == -1 && var->sink_opened != -1 && var->sink_opened == is_opened) {
+        pa_log_debug("Already executed actions for state change, skip.");
+        return false;
+    }
+
+    var->sink_opened = is_opened;
+
+    for (actn = rule->actions; actn; actn = actn->any.next)
+    {
+        if (!perform_action(var->userdata, actn, NULL))
+            pa_log("Failed to perform activity action.");
+    }
+
+    return true;
+}
+
 /* force_state can be -1  - do not force , 0 force inactive, 1 force active */
 static int perform_activity_action(pa_sink *sink, struct pa_policy_activity_variable *var, int force_state) {
     struct pa_policy_context_rule     *rule;
-    union pa_policy_context_action    *actn;
     int                                is_opened;
 
     pa_assert(sink);
 
-    if ((force_state != -1 && force_state == 1) ||
-        (force_state == -1 && PA_SINK_IS_OPENED(sink->state))) {
-        rule = var->active_rules;
-        is_opened = 1;
-    } else {
-        rule = var->inactive_rules;
-        is_opened = 0;
-    }
+    is_opened = activity_state(sink, force_state);
+    rule      = is_opened ? var->active_rules : var->inactive_rules;
 
     for ( ;  rule != NULL;  rule = rule->next) {
         if (pa_policy_match(rule->match, sink->name)) {
-
-            if (force_state == -1 && var->sink_opened != -1 && var->sink_opened == is_opened) {
-                pa_log_debug("Already executed actions for state change, skip.");
+            if (!run_activity_rule(var, rule, is_opened, force_state))
                 return 1;
-            }
+        }
+    }
+
+    return 1;
+}
+
+/* The activity rules are fixed once the configuration is loaded, so the
+ * rules matching a sink name are looked up once and kept. */
+static struct pa_policy_activity_sink *get_activity_sink(struct userdata *u,
+                                                         const char *name)
+{
+    struct pa_policy_context           *ctx = u->context;
+    struct pa_policy_activity_sink     *as;
+    struct pa_policy_activity_variable *var;
+    struct pa_policy_context_rule      *rule;
+    size_t                              n;
+    int                                 opened;
+
+    if (!ctx->activity_sinks) {
+        ctx->activity_sinks = pa_hashmap_new_full(pa_idxset_string_hash_func,
+                                                  pa_idxset_string_compare_func,
+                                                  pa_xfree, pa_xfree);
+    }
+
+    if ((as = pa_hashmap_get(ctx->activity_sinks, name)) != NULL)
+        return as;
 
-            var->sink_opened = is_opened;
+    n = 0;
 
-            for (actn = rule->actions; actn; actn = actn->any.next)
-            {
-                if (!perform_action(var->userdata, actn, NULL))
-                    pa_log("Failed to perform activity action.");
+    for (var = ctx->activities;  var != NULL;  var = var->next) {
+        for (rule = var->active_rules;  rule;  rule = rule->next)
+            n++;
+        for (rule = var->inactive_rules;  rule;  rule = rule->next)
+            n++;
+    }
+
+    as = pa_xmalloc0(sizeof(*as) + n * sizeof(as->matches[0]));
+
+    for (var = ctx->activities;  var != NULL;  var = var->next) {
+        for (opened = 1;  opened >= 0;  opened--) {
+            rule = opened ? var->active_rules : var->inactive_rules;
+
+            for ( ;  rule != NULL;  rule = rule->next) {
+                if (pa_policy_match(rule->match, name)) {
+                    as->matches[as->nmatch].var    = var;
+                    as->matches[as->nmatch].rule   = rule;
+                    as->matches[as->nmatch].opened = opened;
+                    as->nmatch++;
+                }
             }
         }
     }
 
-    return 1;
+    pa_hashmap_put(ctx->activity_sinks, pa_xstrdup(name), as);
+
+    return as;
 }
 
-static pa_hook_result_t sink_state_changed_cb(pa_core *c, pa_object *o, struct pa_policy_activity_variable *var) {
-    pa_sink *sink;
+void pa_policy_activity_sink_state_changed(struct userdata *u, pa_sink *sink)
+{
+    struct pa_policy_activity_sink     *as;
+    struct pa_policy_activity_match    *m;
+    struct pa_policy_activity_variable *done = NULL;
+    size_t                              i;
 
-    pa_assert(c);
-    pa_object_assert_ref(o);
-    pa_assert(var);
+    pa_assert(u);
+    pa_assert(u->context);
+    pa_assert(sink);
 
-    if (pa_sink_isinstance(o)) {
-        sink = PA_SINK(o);
-        perform_activity_action(sink, var, var->default_state);
-    }
+    if (!u->context->activities || !sink->name)
+        return;
 
-    return PA_HOOK_OK;
+    as = get_activity_sink(u, sink->name);
+
+    /* matches are grouped by variable and kept in rule order */
+    for (i = 0;  i < as->nmatch;  i++) {
+        m = as->matches + i;
+
+        if (!m->var->active || m->var == done)
+            continue;
+
+        if (m->opened != activity_state(sink, m->var->default_state))
+            continue;
+
+        if (!run_activity_rule(m->var, m->rule, m->opened, m->var->default_state))
+            done = m->var;
+    }
 }
 
 static void apply_activity(struct userdata *u, struct pa_policy_activity_variable *var) {
@@ -1301,12 +1832,10 @@ static void enable_activity(struct userdata *u, struct pa_policy_activity_variab
     pa_assert(u);
     pa_assert(var);
 
-    if (var->sink_state_changed_hook_slot)
+    if (var->active)
         return;
 
-    var->sink_state_changed_hook_slot = pa_hook_connect(&u->core->hooks[PA_CORE_HOOK_SINK_STATE_CHANGED],
-                                                        PA_HOOK_EARLY,
-                                                        (pa_hook_cb_t) sink_state_changed_cb, var);
+    var->active = true;
 
     var->sink_opened = -1;
     pa_log_debug("enabling activity for %s", var->device);
@@ -1317,15 +1846,14 @@ static void disable_activity(struct userdata *u, struct pa_policy_activity_varia
     pa_assert(u);
     pa_assert(var);
 
-    if (!var->sink_state_changed_hook_slot)
+    if (!var->active)
         return;
 
     var->sink_opened = -1;
     pa_log_debug("disabling activity for %s", var->device);
     apply_activity(u, var);
 
-    pa_hook_slot_free(var->sink_state_changed_hook_slot);
-    var->sink_state_changed_hook_slot = NULL;
+    var->active = false;
 }
 
 int pa_policy_activity_device_changed(struct userdata *u, const char *device)
@@ -1333,8 +1861,10 @@ int pa_policy_activity_device_changed(struct userdata *u, const char *device)
     struct pa_policy_activity_variable *var;
     int                                 success = 0;
 
+    device = pa_policy_atom_find(u->atoms, device);
+
     for (var = u->context->activities;  var != NULL;  var = var->next) {
-        if (!strcmp(device, var->device))
+        if (device == var->device)
             enable_activity(u, var);
         else
             disable_activity(u, var);
@@ -1349,13 +1879,18 @@ void pa_policy_activity_register(struct userdata *u,
 {
     struct pa_policy_activity_variable *var;
     struct pa_policy_context_rule      *rule;
+    struct pa_policy_match_snapshot     snap;
+
+    pa_policy_match_snapshot_init(&snap, u->match_keys, type, ptr);
 
     for (var = u->context->activities;   var != NULL;   var = var->next) {
         for (rule = var->active_rules;   rule != NULL;   rule = rule->next)
-            register_rule(rule, type, name, ptr);
+            register_rule(rule, &snap, name);
         for (rule = var->inactive_rules;   rule != NULL;   rule = rule->next)
-            register_rule(rule, type, name, ptr);
+            register_rule(rule, &snap, name);
     }  /*  for var */
+
+    pa_policy_match_snapshot_done(&snap);
 }
 
 void pa_policy_activity_unregister(struct userdata *u,
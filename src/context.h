@@ -4,7 +4,6 @@
 #include "classify.h"
 #include "match.h"
 
-#define PA_POLICY_CONTEXT_MAX_CHANGES (16)
 
 enum pa_policy_action_type {
     pa_policy_action_unknown = 0,
@@ -89,6 +88,22 @@ struct pa_policy_override {
     int                                 active;
 };
 
+/* Reference to the object of a context action */
+struct pa_policy_object_ref {
+    struct pa_policy_object_ref        *next;      /* next of the same type */
+    struct pa_policy_object_ref        *name_next; /* next of the same bucket */
+    struct pa_policy_object            *object;
+    int                                 lineno;
+};
+
+/* Objects of the context actions that can bind to one object type. Objects
+ * matched by an exact name are bucketed by that name. */
+struct pa_policy_object_index {
+    struct pa_policy_object_ref        *all;
+    pa_hashmap                         *names;  /* name -> object refs */
+    struct pa_policy_object_ref        *other;  /* not matched by exact name */
+};
+
 union pa_policy_context_action {
     struct pa_policy_context_action_any any;
     struct pa_policy_set_property       setprop;
@@ -101,13 +116,27 @@ struct pa_policy_context_rule {
     struct pa_policy_context_rule      *next;
     pa_policy_match_object             *match;
     union pa_policy_context_action     *actions;
+    uint32_t                            seq;        /* definition order */
+    struct pa_policy_context_rule      *value_next; /* next in value index */
 };
 
+/* Rules of a variable in definition order */
+struct pa_policy_context_rule_chain {
+    struct pa_policy_context_rule      *first;
+    struct pa_policy_context_rule      *last;
+};
+
+/* Rules using the 'equals' method are indexed by their value, so a value
+ * change only evaluates the rules of that value and the rules using any
+ * other method. */
 struct pa_policy_context_variable {
     struct pa_policy_context_variable  *next;
     char                               *name;
     char                               *value;
     struct pa_policy_context_rule      *rules;
+    uint32_t                            nrule;
+    pa_hashmap                         *equals; /* value -> rule chain */
+    struct pa_policy_context_rule_chain other;  /* rules of other methods */
 };
 
 struct pa_policy_activity_rule {
@@ -118,27 +147,61 @@ struct pa_policy_activity_rule {
 
 struct pa_policy_activity_variable {
     struct pa_policy_activity_variable *next;
-    char                               *device;
+    const char                         *device;  /* atom */
     struct pa_policy_context_rule      *active_rules;
     struct pa_policy_context_rule      *inactive_rules;
     struct userdata                    *userdata;
-    /* activity variable is active if hook slot pointer is not-null */
-    pa_hook_slot                       *sink_state_changed_hook_slot;
+    bool                                active;  /* follows sink states */
     int                                 default_state; /* -1 select based on sink running/suspended,
                                                           1 active, 0 inactive */
     /* cache some values when variable is active */
     int                                 sink_opened; /* -1 not set, 0 closed, 1 opened */
 };
 
+/* Activity rules matching the name of a sink */
+struct pa_policy_activity_match {
+    struct pa_policy_activity_variable *var;
+    struct pa_policy_context_rule      *rule;
+    int                                 opened;  /* 1 active, 0 inactive rule */
+};
+
+struct pa_policy_activity_sink {
+    size_t                              nmatch;
+    struct pa_policy_activity_match     matches[];
+};
+
+struct pa_policy_context_change {
+    union pa_policy_context_action     *action;
+    size_t                              value;  /* offset in the value arena */
+    bool                                skip;   /* overwritten later */
+};
+
+/* Actions to perform on commit. The buffers are kept between commits and
+ * grow as needed; every value is stored once in the arena, however many
+ * actions refer to it. */
+struct pa_policy_context_changes {
+    struct pa_policy_context_change    *entries;
+    size_t                              count;
+    size_t                              size;
+    char                               *arena;
+    size_t                              used;
+    size_t                              length;
+};
+
 struct pa_policy_context {
     struct pa_policy_context_variable  *variables;
+    pa_hashmap                         *varmap;     /* name -> variable */
+    struct pa_policy_object_index       objects[pa_policy_object_max];
     struct pa_policy_activity_variable *activities;
-    struct variable_change {
-        union pa_policy_context_action *action;
-        char                            *value;
-    } variable_change[PA_POLICY_CONTEXT_MAX_CHANGES];
-    int                                 variable_change_count;
+    struct pa_policy_context_changes    changes;
+    pa_hashmap                         *dirty;  /* ptr -> object whose proplist
+                                                   changed in the current
+                                                   commit, or NULL */
     union pa_policy_context_action     *overrides;
+    pa_hashmap                         *active_overrides; /* "card name:profile"
+                                                             -> override */
+    pa_hashmap                         *activity_sinks; /* sink name -> activity
+                                                           rules of the sink */
 };
 
 
@@ -187,6 +250,10 @@ int pa_context_override_card_profile(struct userdata *u,
                                      const char *pn,
                                      const char **override_pn);
 
+/* Index the rules once the configuration is loaded; rules are matched
+ * against the final state of their match objects. */
+void pa_policy_context_build_index(struct userdata *u);
+
 /* collect context variable change as name and value. */
 int pa_policy_context_variable_changed(struct userdata *u, const char *name, const char *value);
 /* commit variable changes to proplists. this needs to be always called after adding
@@ -208,6 +275,8 @@ struct pa_policy_context_rule
                                           enum pa_classify_method method, const char *sink_name);
 
 int pa_policy_activity_device_changed(struct userdata *u, const char *device);
+/* Run the activity rules of the active activity variables for the sink */
+void pa_policy_activity_sink_state_changed(struct userdata *u, pa_sink *sink);
 
 void pa_policy_activity_register(struct userdata *, enum pa_policy_object_type,
                                  const char *, void *);
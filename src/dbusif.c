@@ -45,6 +45,11 @@
 #define POLICY_STREAM_INFO          "stream_info"
 #define POLICY_ACTIONS              "audio_actions"
 #define POLICY_STATUS               "status"
+/* Served on the module's own connection, which owns no well-known name;
+ * the unique name is logged when the module is loaded. The system bus
+ * policy has to allow the call. The same counters are always available
+ * in the module property list (policy.group.<name>.stats). */
+#define POLICY_GET_GROUP_STATS      "GetGroupStats"
 
 #define PROP_ROUTE_SINK_TARGET      "policy.sink_route.target"
 #define PROP_ROUTE_SINK_MODE        "policy.sink_route.mode"
@@ -85,11 +90,31 @@ struct pa_policy_dbusif {
     char               *strrule; /* match rule to catch stream info signals */
     bool                regist;  /* wheter or not registered to policy daemon*/
     bool                route_sources_first;
+    pa_defer_event     *devstate_flush;  /* sends the queued device states */
+    struct pa_classify_result devstate_connected;    /* queued connects */
+    struct pa_classify_result devstate_disconnected; /* queued disconnects */
+};
+
+struct txn_value {              /* last setting of an action target */
+    const char         *name;
+    const char         *string;
+    int32_t             integer;
+};
+
+struct policy_txn {             /* end state requested by a transaction */
+    struct routing_decision routes[MAX_ROUTING_DECISIONS];
+    int                 num_routes;
+    pa_hashmap         *limits;   /* group name -> volume limit */
+    pa_hashmap         *corks;    /* group name -> cork */
+    pa_hashmap         *mutes;    /* device type -> mute */
+    pa_hashmap         *contexts; /* variable name -> value */
 };
 
 struct actdsc {                 /* action descriptor */
     const char         *name;
-    int               (*parser)(struct userdata *u, DBusMessageIter *iter);
+    int               (*parser)(struct userdata *u, DBusMessageIter *iter,
+                                struct policy_txn *txn);
+    int               (*apply)(struct userdata *u, struct policy_txn *txn);
 };
 
 struct argdsc {                 /* argument descriptor for actions */
@@ -126,16 +151,32 @@ struct argctx {                 /* context arguments */
 };
 
 static int action_parser(DBusMessageIter *, struct argdsc *, void *, int);
-static int audio_route_parser(struct userdata *, DBusMessageIter *);
-static int volume_limit_parser(struct userdata *, DBusMessageIter *);
-static int audio_cork_parser(struct userdata *, DBusMessageIter *);
-static int audio_mute_parser(struct userdata *, DBusMessageIter *);
-static int context_parser(struct userdata *, DBusMessageIter *);
+static int audio_route_parser(struct userdata *, DBusMessageIter *,
+                              struct policy_txn *);
+static int volume_limit_parser(struct userdata *, DBusMessageIter *,
+                               struct policy_txn *);
+static int audio_cork_parser(struct userdata *, DBusMessageIter *,
+                             struct policy_txn *);
+static int audio_mute_parser(struct userdata *, DBusMessageIter *,
+                             struct policy_txn *);
+static int context_parser(struct userdata *, DBusMessageIter *,
+                          struct policy_txn *);
+static int audio_route_apply(struct userdata *, struct policy_txn *);
+static int volume_limit_apply(struct userdata *, struct policy_txn *);
+static int audio_cork_apply(struct userdata *, struct policy_txn *);
+static int audio_mute_apply(struct userdata *, struct policy_txn *);
+static int context_apply(struct userdata *, struct policy_txn *);
+static void txn_init(struct policy_txn *);
+static void txn_done(struct policy_txn *);
+static pa_hashmap *txn_map_new(void);
+static void txn_set(pa_hashmap *, const char *, const char *, int32_t);
 
 static DBusHandlerResult filter(DBusConnection *, DBusMessage *, void *);
 static void handle_admin_message(struct userdata *, DBusMessage *);
 static void handle_info_message(struct userdata *, DBusMessage *);
 static void handle_action_message(struct userdata *, DBusMessage *);
+static void handle_group_stats_request(struct userdata *, DBusMessage *);
+static void append_group_counter(const char *, uint64_t, void *);
 static void getnameowner_cb(DBusPendingCall *, void *);
 static void pdp_get_state(struct pa_policy_dbusif *, struct userdata *);
 static void pdp_get_state_cancel(struct pa_policy_dbusif *);
@@ -143,6 +184,12 @@ static void registration_cb(DBusPendingCall *, void *);
 static int  pdp_register_ep(struct pa_policy_dbusif *, struct userdata *);
 static void pdp_register_ep_cancel(struct pa_policy_dbusif *);
 static int  signal_status(struct userdata *, uint32_t, uint32_t);
+static void devstate_flush_cb(pa_mainloop_api *, pa_defer_event *, void *);
+static void devstate_flush(struct userdata *);
+static void devstate_queue_drop(struct userdata *);
+static int  append_device_states(struct userdata *, DBusMessageIter *,
+                                 const struct pa_classify_result *, bool,
+                                 int *, int);
 static void pa_policy_free_dbusif(struct pa_policy_dbusif *,struct userdata *);
 
 
@@ -166,6 +213,10 @@ struct pa_policy_dbusif *pa_policy_dbusif_init(struct userdata *u,
 
     dbusif->route_sources_first = route_sources_first;
 
+    dbusif->devstate_flush = m->core->mainloop->defer_new(m->core->mainloop,
+                                                          devstate_flush_cb, u);
+    m->core->mainloop->defer_enable(dbusif->devstate_flush, 0);
+
     dbus_error_init(&error);
     dbusif->conn = pa_dbus_bus_get(m->core, DBUS_BUS_SYSTEM, &error);
 
@@ -248,6 +299,9 @@ struct pa_policy_dbusif *pa_policy_dbusif_init(struct userdata *u,
     dbusif->actrule = pa_xstrdup(actrule);
     dbusif->strrule = pa_xstrdup(strrule);
 
+    pa_log_info("serving %s.%s on %s at %s", ifnam, POLICY_GET_GROUP_STATS,
+                dbus_bus_get_unique_name(dbusconn), mypath);
+
     pdp_get_state(dbusif, u);
 
     return dbusif;
@@ -269,6 +323,9 @@ static void pa_policy_free_dbusif(struct pa_policy_dbusif *dbusif,
     pdp_get_state_cancel(dbusif);
     pdp_register_ep_cancel(dbusif);
 
+    if (dbusif->devstate_flush && u)
+        u->core->mainloop->defer_free(dbusif->devstate_flush);
+
     if (dbusif->conn) {
         dbusconn = pa_dbus_connection_get(dbusif->conn);
 
@@ -299,16 +356,100 @@ void pa_policy_dbusif_done(struct userdata *u)
     }
 }
 
-void pa_policy_dbusif_send_device_state(struct userdata *u, bool is_connected, const struct pa_classify_result *list)
+/* Device state changes are queued and sent from a defer event, so a
+ * burst of hook callbacks (eg. a card with its sinks and sources
+ * appearing) ends up in a single DeviceStateChangedMany call. Only the
+ * last requested state of each type is kept. Not every queued entry is
+ * a real state change, so opposite changes must not cancel each other. */
+void pa_policy_dbusif_queue_device_state(struct userdata *u, bool is_connected,
+                                         const struct pa_classify_result *list)
+{
+    struct pa_policy_dbusif   *dbusif;
+    struct pa_classify_result *same;
+    struct pa_classify_result *opposite;
+
+    pa_assert(u);
+    pa_assert(list);
+    pa_assert_se((dbusif = u->dbusif));
+
+    if (pa_classify_result_count(list) == 0)
+        return;
+
+    if (is_connected) {
+        same     = &dbusif->devstate_connected;
+        opposite = &dbusif->devstate_disconnected;
+    }
+    else {
+        same     = &dbusif->devstate_disconnected;
+        opposite = &dbusif->devstate_connected;
+    }
+
+    /* the last requested state of a type wins */
+    pa_classify_result_diff(opposite, list);
+    pa_classify_result_union(same, list);
+
+    u->core->mainloop->defer_enable(dbusif->devstate_flush, 1);
+}
+
+static void devstate_flush_cb(pa_mainloop_api *m, pa_defer_event *e,
+                              void *userdata)
+{
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+
+    devstate_flush(u);
+}
+
+/* Sends the queued device states now. Called before any other device
+ * notification, so that the daemon sees the changes in the order they
+ * happened, eg. a device connect before the profile change it caused. */
+static void devstate_flush(struct userdata *u)
+{
+    struct pa_policy_dbusif   *dbusif;
+    struct pa_classify_result  connected;
+    struct pa_classify_result  disconnected;
+
+    pa_assert_se((dbusif = u->dbusif));
+
+    connected    = dbusif->devstate_connected;
+    disconnected = dbusif->devstate_disconnected;
+
+    pa_policy_dbusif_send_device_state(u, &disconnected, &connected);
+}
+
+static void devstate_queue_drop(struct userdata *u)
+{
+    struct pa_policy_dbusif *dbusif = u->dbusif;
+
+    pa_classify_result_clear(&dbusif->devstate_connected);
+    pa_classify_result_clear(&dbusif->devstate_disconnected);
+    u->core->mainloop->defer_enable(dbusif->devstate_flush, 0);
+}
+
+void pa_policy_dbusif_send_device_state(struct userdata *u,
+                                        const struct pa_classify_result *disconnected,
+                                        const struct pa_classify_result *connected)
 {
-    int                      success     = 0;
     DBusConnection          *conn        = pa_dbus_connection_get(u->dbusif->conn);
     DBusMessage             *msg         = NULL;
     DBusMessageIter          msg_it;
     DBusMessageIter          array_it;
-    dbus_int32_t             driver      = is_connected ? 1 : 0;
-    dbus_int32_t             connected   = -1;
     dbus_uint32_t            serial      = 0;
+    int                      n           = 0;
+    int                      count;
+
+    pa_assert(disconnected);
+    pa_assert(connected);
+
+    /* the queued changes are either sent now or superseded by this */
+    devstate_queue_drop(u);
+
+    count = pa_classify_result_count(disconnected) +
+            pa_classify_result_count(connected);
+
+    if (count == 0)
+        return;
 
     msg = dbus_message_new_method_call(POLICY_DBUS_PDNAME,
                                        SAILFISH_DBUS_POLICY_PATH,
@@ -327,25 +468,13 @@ void pa_policy_dbusif_send_device_state(struct userdata *u, bool is_connected, c
         goto done;
     }
 
-    for (int i = 0; i < list->count; i++) {
-        DBusMessageIter struct_it;
-        dbus_message_iter_open_container(&array_it, DBUS_TYPE_STRUCT, NULL, &struct_it);
-
-        if (!dbus_message_iter_append_basic(&struct_it, DBUS_TYPE_STRING, &list->types[i]) ||
-            !dbus_message_iter_append_basic(&struct_it, DBUS_TYPE_INT32, &driver) ||
-            !dbus_message_iter_append_basic(&struct_it, DBUS_TYPE_INT32, &connected)) {
-            pa_log("failed to build device state changed message");
-            goto done;
-        }
-
-        dbus_message_iter_close_container(&array_it, &struct_it);
-        pa_log_info("Update device state [%d/%d] type %s -> %s",
-                    i + 1, list->count, list->types[i], is_connected ? "connected" : "disconnected");
-    }
+    if (append_device_states(u, &array_it, disconnected, false, &n, count) < 0 ||
+        append_device_states(u, &array_it, connected, true, &n, count) < 0)
+        goto done;
 
     dbus_message_iter_close_container(&msg_it, &array_it);
 
-    if (!(success = dbus_connection_send(conn, msg, &serial))) {
+    if (!dbus_connection_send(conn, msg, &serial)) {
         pa_log("Failed to send message to set device connected states");
         goto done;
     }
@@ -355,25 +484,58 @@ void pa_policy_dbusif_send_device_state(struct userdata *u, bool is_connected, c
         dbus_message_unref(msg);
 }
 
+static int append_device_states(struct userdata *u, DBusMessageIter *array_it,
+                                const struct pa_classify_result *list,
+                                bool is_connected, int *n, int count)
+{
+    dbus_int32_t             driver      = is_connected ? 1 : 0;
+    dbus_int32_t             connected   = -1;
+    const char              *type;
+    int                      id;
+
+    PA_CLASSIFY_RESULT_FOREACH(id, list) {
+        DBusMessageIter struct_it;
+        type = pa_classify_type_name(u, id);
+        dbus_message_iter_open_container(array_it, DBUS_TYPE_STRUCT, NULL, &struct_it);
+
+        if (!dbus_message_iter_append_basic(&struct_it, DBUS_TYPE_STRING, &type) ||
+            !dbus_message_iter_append_basic(&struct_it, DBUS_TYPE_INT32, &driver) ||
+            !dbus_message_iter_append_basic(&struct_it, DBUS_TYPE_INT32, &connected)) {
+            pa_log("failed to build device state changed message");
+            return -1;
+        }
+
+        dbus_message_iter_close_container(array_it, &struct_it);
+        pa_log_info("Update device state [%d/%d] type %s -> %s",
+                    ++*n, count, type, is_connected ? "connected" : "disconnected");
+    }
+
+    return 0;
+}
+
 void pa_policy_dbusif_send_card_profile_changed(struct userdata *u, const struct pa_classify_result *list,
                                                 const char *profile)
 {
     struct pa_policy_dbusif *dbusif = u->dbusif;
     DBusConnection          *conn   = pa_dbus_connection_get(dbusif->conn);
     DBusMessage             *msg    = NULL;
-    uint32_t                 i;
+    const char              *type;
+    int                      id;
     int                      success;
 
+    devstate_flush(u);
+
     if (!dbusif->regist)
         return;
 
-    if (!list || list->count == 0)
+    if (!list || pa_classify_result_count(list) == 0)
         return;
 
     if (!profile)
         return;
 
-    for (i = 0; i < list->count; i++) {
+    PA_CLASSIFY_RESULT_FOREACH(id, list) {
+        type = pa_classify_type_name(u, id);
         msg = dbus_message_new_method_call(POLICY_DBUS_PDNAME,
                                            SAILFISH_DBUS_POLICY_PATH,
                                            SAILFISH_DBUS_POLICY_IFACE,
@@ -386,7 +548,7 @@ void pa_policy_dbusif_send_card_profile_changed(struct userdata *u, const struct
 
         if (!(success = dbus_message_append_args(msg,
                                                  DBUS_TYPE_STRING, &profile,
-                                                 DBUS_TYPE_STRING, &list->types[i],
+                                                 DBUS_TYPE_STRING, &type,
                                                  DBUS_TYPE_INVALID))) {
             pa_log("Failed to build D-Bus " SAILFISH_DBUS_CARD_PROFILE_CHANGED " message");
             break;
@@ -456,6 +618,8 @@ void pa_policy_dbusif_send_port_available_changed(struct userdata *u,
     dbus_int32_t    connected   = available ? 1 : 0;
     dbus_uint32_t   serial      = 0;
 
+    devstate_flush(u);
+
     msg = dbus_message_new_method_call(POLICY_DBUS_PDNAME,
                                        SAILFISH_DBUS_POLICY_PATH,
                                        SAILFISH_DBUS_POLICY_IFACE,
@@ -510,6 +674,14 @@ static DBusHandlerResult filter(DBusConnection *conn, DBusMessage *msg,
         return DBUS_HANDLER_RESULT_HANDLED;
     }
 
+    if (dbus_message_is_method_call(msg, u->dbusif->ifnam,
+                                    POLICY_GET_GROUP_STATS) &&
+        dbus_message_has_path(msg, u->dbusif->mypath))
+    {
+        handle_group_stats_request(u, msg);
+        return DBUS_HANDLER_RESULT_HANDLED;
+    }
+
     return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
@@ -618,7 +790,7 @@ static void handle_info_message(struct userdata *u, DBusMessage *msg)
         else {
             pa_log_debug("register client (%s|%s)", group, app_id);
             pa_classify_register_app_id(u, app_id, prop, method, arg, group);
-            pa_sink_input_ext_rediscover(u);
+            pa_sink_input_ext_rediscover(u, app_id);
         }
     }
     else if (!strcmp(oper, "unregister")) {
@@ -632,13 +804,14 @@ static void handle_info_message(struct userdata *u, DBusMessage *msg)
 
 static void handle_action_message(struct userdata *u, DBusMessage *msg)
 {
+    /* actions are applied in this order, whatever order they came in */
     static struct actdsc actions[] = {
-        { "com.nokia.policy.audio_route" , audio_route_parser  },
-        { "com.nokia.policy.volume_limit", volume_limit_parser },
-        { "com.nokia.policy.audio_cork"  , audio_cork_parser   },
-        { "com.nokia.policy.audio_mute"  , audio_mute_parser   },
-        { "com.nokia.policy.context"     , context_parser      },
-        {               NULL             , NULL                }
+        { "com.nokia.policy.audio_route" , audio_route_parser , audio_route_apply  },
+        { "com.nokia.policy.volume_limit", volume_limit_parser, volume_limit_apply },
+        { "com.nokia.policy.audio_cork"  , audio_cork_parser  , audio_cork_apply   },
+        { "com.nokia.policy.audio_mute"  , audio_mute_parser  , audio_mute_apply   },
+        { "com.nokia.policy.context"     , context_parser     , context_apply      },
+        {               NULL             , NULL               , NULL               }
     };
 
     struct actdsc   *act;
@@ -648,6 +821,7 @@ static void handle_action_message(struct userdata *u, DBusMessage *msg)
     DBusMessageIter  arrit;
     DBusMessageIter  entit;
     DBusMessageIter  actit;
+    struct policy_txn txn;
     int              success = true;
 
     pa_log_debug("got policy actions");
@@ -661,12 +835,21 @@ static void handle_action_message(struct userdata *u, DBusMessage *msg)
 
     pa_log_debug("got actions (txid:%d)", txid);
 
+    pa_policy_group_moves_begin(u);
+
     if (!dbus_message_iter_next(&msgit) ||
         dbus_message_iter_get_arg_type(&msgit) != DBUS_TYPE_ARRAY) {
         success = false;
         goto send_signal;
     }
 
+    /*
+     * Collect the end state of the transaction first, so that a stream
+     * is not, for instance, moved twice or corked and then uncorked.
+     * The settings point to the strings of the message.
+     */
+    txn_init(&txn);
+
     dbus_message_iter_recurse(&msgit, &arrit);
 
     do {
@@ -704,18 +887,85 @@ static void handle_action_message(struct userdata *u, DBusMessage *msg)
             }
                                     
             if (act->parser != NULL)
-                success &= act->parser(u, &actit);
+                success &= act->parser(u, &actit, &txn);
 
         } while (dbus_message_iter_next(&entit));
 
     } while (dbus_message_iter_next(&arrit));
 
+    /* then make the changes; these skip what is already in place */
+    for (act = actions;   act->name != NULL;   act++)
+        success &= act->apply(u, &txn);
+
+    txn_done(&txn);
+
     pa_policy_context_variable_commit(u);
 
  send_signal:
+    pa_policy_group_moves_report(u, txid);
+    pa_policy_groupset_export_stats(u);
     signal_status(u, txid, success);
 }
 
+/*
+ * Reply with the runtime counters of all groups as an array of
+ * (group name, {counter name: value}).
+ */
+static void handle_group_stats_request(struct userdata *u, DBusMessage *msg)
+{
+    DBusConnection          *conn = pa_dbus_connection_get(u->dbusif->conn);
+    struct pa_policy_group  *group;
+    DBusMessage             *reply;
+    DBusMessageIter          msgit;
+    DBusMessageIter          arrit;
+    DBusMessageIter          grpit;
+    DBusMessageIter          dictit;
+
+    if ((reply = dbus_message_new_method_return(msg)) == NULL) {
+        pa_log("failed to create " POLICY_GET_GROUP_STATS " reply");
+        return;
+    }
+
+    dbus_message_iter_init_append(reply, &msgit);
+    dbus_message_iter_open_container(&msgit, DBUS_TYPE_ARRAY, "(sa{st})",
+                                     &arrit);
+
+    for (group = pa_policy_group_next(u, NULL);  group;
+         group = pa_policy_group_next(u, group))
+    {
+        dbus_message_iter_open_container(&arrit, DBUS_TYPE_STRUCT, NULL,
+                                         &grpit);
+        dbus_message_iter_append_basic(&grpit, DBUS_TYPE_STRING, &group->name);
+        dbus_message_iter_open_container(&grpit, DBUS_TYPE_ARRAY, "{st}",
+                                         &dictit);
+
+        pa_policy_group_stats_foreach(group, append_group_counter, &dictit);
+
+        dbus_message_iter_close_container(&grpit, &dictit);
+        dbus_message_iter_close_container(&arrit, &grpit);
+    }
+
+    dbus_message_iter_close_container(&msgit, &arrit);
+
+    if (!dbus_connection_send(conn, reply, NULL))
+        pa_log("Can't send " POLICY_GET_GROUP_STATS " reply");
+
+    dbus_message_unref(reply);
+}
+
+static void append_group_counter(const char *name, uint64_t value, void *data)
+{
+    DBusMessageIter *dictit = data;
+    DBusMessageIter  entit;
+    dbus_uint64_t    val    = value;
+
+    dbus_message_iter_open_container(dictit, DBUS_TYPE_DICT_ENTRY, NULL,
+                                     &entit);
+    dbus_message_iter_append_basic(&entit, DBUS_TYPE_STRING, &name);
+    dbus_message_iter_append_basic(&entit, DBUS_TYPE_UINT64, &val);
+    dbus_message_iter_close_container(dictit, &entit);
+}
+
 static int action_parser(DBusMessageIter *actit, struct argdsc *descs,
                          void *args, int len)
 {
@@ -779,7 +1029,8 @@ static void port_changes_done_cb(struct userdata *u)
                                           PA_SAILFISHOS_MEDIA_VOLUME_CHANGE_DONE);
 }
 
-static int audio_route_parser(struct userdata *u, DBusMessageIter *actit)
+static int audio_route_parser(struct userdata *u, DBusMessageIter *actit,
+                              struct policy_txn *txn)
 {
     static struct argdsc descs[] = {
         {"type"  , STRUCT_OFFSET(struct argrt, type)  , DBUS_TYPE_STRING },
@@ -790,17 +1041,12 @@ static int audio_route_parser(struct userdata *u, DBusMessageIter *actit)
     };
 
     struct argrt args;
-    pa_proplist *p = NULL;
     struct routing_decision decisions[MAX_ROUTING_DECISIONS];
     int num_decisions = 0;
-    int num_decisions_done = 0;
     int i = 0;
-    int num_moving = 0;
-    bool result = true;
-    bool route_changed = false;
-    bool sink_route_changed = false;
+    int j;
 
-    /* Parse message. It's safe to bail out here, because we're not moving any streams yet. */
+    /* Parse message. A broken action is dropped as a whole. */
     do {
         i = num_decisions;
         num_decisions++;
@@ -831,8 +1077,43 @@ static int audio_route_parser(struct userdata *u, DBusMessageIter *actit)
                                                           decisions[i].mode,
                                                           decisions[i].hwid);
 
-        p = u->module->proplist;
+    } while (dbus_message_iter_next(actit));
+
+    /* a later decision of the same class overrides the earlier one */
+    for (i = 0; i < num_decisions; i++) {
+        for (j = 0; j < txn->num_routes; j++) {
+            if (txn->routes[j].class == decisions[i].class)
+                break;
+        }
+
+        if (j == txn->num_routes) {
+            if (txn->num_routes >= MAX_ROUTING_DECISIONS)
+                return false;
+            txn->num_routes++;
+        }
+
+        txn->routes[j] = decisions[i];
+    }
+
+    return true;
+}
 
+static int audio_route_apply(struct userdata *u, struct policy_txn *txn)
+{
+    pa_proplist *p = NULL;
+    struct routing_decision *decisions = txn->routes;
+    int num_decisions = txn->num_routes;
+    int num_decisions_done = 0;
+    int i = 0;
+    int num_routable;
+    int num_detached = 0;
+    bool result = true;
+    bool route_changed = false;
+    bool sink_route_changed = false;
+
+    p = u->module->proplist;
+
+    for (i = 0; i < num_decisions; i++) {
         if (decisions[i].class == pa_policy_route_to_sink) {
             if (!pa_streq(pa_strempty(pa_proplist_gets(p, PROP_ROUTE_SINK_TARGET)), decisions[i].target) ||
                 !pa_streq(pa_strempty(pa_proplist_gets(p, PROP_ROUTE_SINK_MODE  )), decisions[i].mode)   ||
@@ -854,17 +1135,19 @@ static int audio_route_parser(struct userdata *u, DBusMessageIter *actit)
                 pa_log_debug("Source route has changed");
             }
         }
-
-    } while (dbus_message_iter_next(actit));
+    }
 
     if (!route_changed) {
         pa_log_debug("New audio route is identical to the current one. No need to move streams.");
         return true;
     }
 
-    /* Detach groups. */
-    num_moving = pa_policy_group_start_move_all(u);
-    pa_log_debug("Policy groups moving: %d", num_moving);
+    /* Detach the streams whose sink or source changes. */
+    num_routable = pa_policy_group_count_routable(u);
+    for (i = 0; i < num_decisions; i++)
+        num_detached += pa_policy_group_start_move(u, decisions[i].class, decisions[i].target);
+    pa_log_debug("Detached %d streams of %d routable policy groups",
+                 num_detached, num_routable);
 
     if (u->dbusif->route_sources_first) {
         /* Following works only if MAX_ROUTING_DECISIONS is 2, so make sure this is
@@ -929,7 +1212,7 @@ static int audio_route_parser(struct userdata *u, DBusMessageIter *actit)
                          num_moved,
                          decisions[i].class == pa_policy_route_to_sink ? "sink" : "source",
                          decisions[i].target);
-            if (num_moving == num_moved)
+            if (num_routable == num_moved)
                 num_decisions_done++;
         }
     }
@@ -949,7 +1232,8 @@ static int audio_route_parser(struct userdata *u, DBusMessageIter *actit)
     return result;
 }
 
-static int volume_limit_parser(struct userdata *u, DBusMessageIter *actit)
+static int volume_limit_parser(struct userdata *u, DBusMessageIter *actit,
+                               struct policy_txn *txn)
 {
     static struct argdsc descs[] = {
         {"group", STRUCT_OFFSET(struct argvol, group), DBUS_TYPE_STRING },
@@ -973,16 +1257,31 @@ static int volume_limit_parser(struct userdata *u, DBusMessageIter *actit)
 
         pa_log_debug("volume limit (%s|%d)", args.group, args.limit); 
 
-        pa_policy_group_volume_limit(u, args.group, (uint32_t)args.limit);
+        txn_set(txn->limits, args.group, NULL, args.limit);
 
     } while (dbus_message_iter_next(actit));
 
+    return success;
+}
+
+static int volume_limit_apply(struct userdata *u, struct policy_txn *txn)
+{
+    struct txn_value *v;
+    void             *state;
+
+    if (pa_hashmap_isempty(txn->limits))
+        return true;
+
+    PA_HASHMAP_FOREACH(v, txn->limits, state)
+        pa_policy_group_volume_limit(u, v->name, (uint32_t)v->integer);
+
     pa_sink_ext_set_volumes(u);
 
-    return success;
+    return true;
 }
 
-static int audio_cork_parser(struct userdata *u, DBusMessageIter *actit)
+static int audio_cork_parser(struct userdata *u, DBusMessageIter *actit,
+                             struct policy_txn *txn)
 {
     static struct argdsc descs[] = {
         {"group", STRUCT_OFFSET(struct argcork, group), DBUS_TYPE_STRING },
@@ -1011,14 +1310,26 @@ static int audio_cork_parser(struct userdata *u, DBusMessageIter *actit)
             return false;
         
         pa_log_debug("cork stream (%s|%d)", grp, val);
-        pa_policy_group_cork(u, grp, val);
+        txn_set(txn->corks, grp, NULL, val);
 
     } while (dbus_message_iter_next(actit));
     
     return true;
 }
 
-static int audio_mute_parser(struct userdata *u, DBusMessageIter *actit)
+static int audio_cork_apply(struct userdata *u, struct policy_txn *txn)
+{
+    struct txn_value *v;
+    void             *state;
+
+    PA_HASHMAP_FOREACH(v, txn->corks, state)
+        pa_policy_group_cork(u, v->name, v->integer);
+
+    return true;
+}
+
+static int audio_mute_parser(struct userdata *u, DBusMessageIter *actit,
+                             struct policy_txn *txn)
 {
     static struct argdsc descs[] = {
         {"device", STRUCT_OFFSET(struct argmute, device), DBUS_TYPE_STRING },
@@ -1047,14 +1358,26 @@ static int audio_mute_parser(struct userdata *u, DBusMessageIter *actit)
             return false;
         
         pa_log_debug("mute device (%s|%d)", device, val);
-        pa_source_ext_set_mute(u, device, val);
+        txn_set(txn->mutes, device, NULL, val);
 
     } while (dbus_message_iter_next(actit));
     
     return true;
 }
 
-static int context_parser(struct userdata *u, DBusMessageIter *actit)
+static int audio_mute_apply(struct userdata *u, struct policy_txn *txn)
+{
+    struct txn_value *v;
+    void             *state;
+
+    PA_HASHMAP_FOREACH(v, txn->mutes, state)
+        pa_source_ext_set_mute(u, v->name, v->integer);
+
+    return true;
+}
+
+static int context_parser(struct userdata *u, DBusMessageIter *actit,
+                          struct policy_txn *txn)
 {
     static struct argdsc descs[] = {
         {"variable", STRUCT_OFFSET(struct argctx,variable), DBUS_TYPE_STRING },
@@ -1073,13 +1396,65 @@ static int context_parser(struct userdata *u, DBusMessageIter *actit)
 
         pa_log_debug("context (%s|%s)", args.variable, args.value);
 
-        pa_policy_context_variable_changed(u, args.variable, args.value);
+        txn_set(txn->contexts, args.variable, args.value, 0);
 
     } while (dbus_message_iter_next(actit));
     
     return true;
 }
 
+static int context_apply(struct userdata *u, struct policy_txn *txn)
+{
+    struct txn_value *v;
+    void             *state;
+
+    PA_HASHMAP_FOREACH(v, txn->contexts, state)
+        pa_policy_context_variable_changed(u, v->name, v->string);
+
+    return true;
+}
+
+static void txn_init(struct policy_txn *txn)
+{
+    memset(txn, 0, sizeof(*txn));
+
+    txn->limits   = txn_map_new();
+    txn->corks    = txn_map_new();
+    txn->mutes    = txn_map_new();
+    txn->contexts = txn_map_new();
+}
+
+static void txn_done(struct policy_txn *txn)
+{
+    pa_hashmap_free(txn->limits);
+    pa_hashmap_free(txn->corks);
+    pa_hashmap_free(txn->mutes);
+    pa_hashmap_free(txn->contexts);
+}
+
+static pa_hashmap *txn_map_new(void)
+{
+    return pa_hashmap_new_full(pa_idxset_string_hash_func,
+                               pa_idxset_string_compare_func,
+                               NULL, pa_xfree);
+}
+
+static void txn_set(pa_hashmap *map, const char *name, const char *string,
+                    int32_t integer)
+{
+    struct txn_value *v;
+
+    /* the position of the first setting is kept, only the value changes */
+    if (!(v = pa_hashmap_get(map, name))) {
+        v = pa_xnew0(struct txn_value, 1);
+        v->name = name;
+        pa_hashmap_put(map, (void *)v->name, v);
+    }
+
+    v->string  = string;
+    v->integer = integer;
+}
+
 static void getnameowner_cb(DBusPendingCall *pend, void *data)
 {
     struct userdata         *u = data;
@@ -10,8 +10,11 @@ struct pa_policy_dbusif *pa_policy_dbusif_init(struct userdata *, const char *,
                                                const char *, const char *,
                                                const char *, bool);
 void pa_policy_dbusif_done(struct userdata *);
-void pa_policy_dbusif_send_device_state(struct userdata *u, bool is_connected,
-                                        const struct pa_classify_result *list);
+void pa_policy_dbusif_queue_device_state(struct userdata *u, bool is_connected,
+                                         const struct pa_classify_result *list);
+void pa_policy_dbusif_send_device_state(struct userdata *u,
+                                        const struct pa_classify_result *disconnected,
+                                        const struct pa_classify_result *connected);
 void pa_policy_dbusif_send_media_status(struct userdata *, const char *,
                                         const char *, int);
 
@@ -3,7 +3,6 @@
 #endif
 
 #include <pulsecore/log.h>
-#include <pulsecore/strbuf.h>
 #include "log.h"
 
 #ifndef ENV_LOG_LEVEL
@@ -40,19 +39,3 @@ bool pa_policy_log_level_debug()
     else
         return false;
 }
-
-char *pa_policy_log_concat(const char **str, int count)
-{
-    pa_strbuf *buf;
-    int i;
-
-    buf = pa_strbuf_new();
-
-    for (i = 0; i < count; i++) {
-        if (i > 0)
-            pa_strbuf_putc(buf, ' ');
-        pa_strbuf_puts(buf, str[i]);
-    }
-
-    return pa_strbuf_to_string_free(buf);
-}
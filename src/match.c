@@ -1,5 +1,8 @@
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
 
 #ifdef HAVE_CONFIG_H
 #include <config.h>
@@ -8,6 +11,7 @@
 #include <pulsecore/client.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/log.h>
+#include <pulsecore/hashmap.h>
 #include <pulsecore/sink-input.h>
 #include <pulsecore/source-output.h>
 #include <pulsecore/strbuf.h>
@@ -18,6 +22,11 @@
 
 /* #define DEBUG_MATCH 1 */
 
+static struct pa_classify_regex *regex_new(const char *);
+static void regex_free(struct pa_classify_regex *);
+static int regex_automaton_match(struct pa_classify_regex *, const char *);
+static uint32_t match_key_id(struct pa_policy_match_keys *, const char *);
+
 const char *pa_policy_object_type_str(enum pa_policy_object_type obj_type)
 {
     switch (obj_type) {
@@ -67,6 +76,7 @@ pa_policy_match_object *policy_match_new(enum pa_classify_method method,
 
     obj = pa_xnew0(pa_policy_match_object, 1);
     obj->arg_def = string ? pa_xstrdup(string) : NULL;
+    obj->key_id  = PA_IDXSET_INVALID;
 
     switch (method) {
         case pa_method_equals:
@@ -81,7 +91,7 @@ pa_policy_match_object *policy_match_new(enum pa_classify_method method,
 
         case pa_method_matches:
             obj->func = pa_classify_method_matches;
-            if (regcomp(&obj->arg.rexp, obj->arg_def, 0) != 0) {
+            if (!(obj->arg.regex = regex_new(obj->arg_def))) {
                 pa_log("failed to compile regex from '%s'", obj->arg_def);
                 goto fail;
             }
@@ -147,13 +157,15 @@ pa_policy_match_object *pa_policy_match_name_new(enum pa_policy_object_type type
     return obj;
 }
 
-pa_policy_match_object *pa_policy_match_property_new(enum pa_policy_object_type type,
+pa_policy_match_object *pa_policy_match_property_new(struct pa_policy_match_keys *keys,
+                                                     enum pa_policy_object_type type,
                                                      const char *property_name,
                                                      enum pa_classify_method method,
                                                      const char *string)
 {
     pa_policy_match_object *obj = NULL;
 
+    pa_assert(keys);
     pa_assert(property_name);
 
     if (!(obj = policy_match_new(method, string)))
@@ -163,6 +175,7 @@ pa_policy_match_object *pa_policy_match_property_new(enum pa_policy_object_type
     obj->target     = pa_object_property;
     obj->target_def = pa_xstrdup(property_name);
     obj->method     = method;
+    obj->key_id     = match_key_id(keys, obj->target_def);
 
 #ifdef DEBUG_MATCH
     pa_log_debug("new %s match %s %s:%s", policy_object_target_str(obj->target),
@@ -174,7 +187,8 @@ pa_policy_match_object *pa_policy_match_property_new(enum pa_policy_object_type
     return obj;
 }
 
-pa_policy_match_object *pa_policy_match_new(enum pa_policy_object_type type,
+pa_policy_match_object *pa_policy_match_new(struct pa_policy_match_keys *keys,
+                                            enum pa_policy_object_type type,
                                             enum pa_policy_object_target target,
                                             const char *target_def,
                                             enum pa_classify_method method,
@@ -182,6 +196,7 @@ pa_policy_match_object *pa_policy_match_new(enum pa_policy_object_type type,
 {
     pa_policy_match_object *obj = NULL;
 
+    pa_assert(keys);
     pa_assert(method == pa_method_true || arg);
 
     if (type == pa_policy_object_proplist &&
@@ -198,6 +213,9 @@ pa_policy_match_object *pa_policy_match_new(enum pa_policy_object_type type,
     obj->target_def     = pa_xstrdup(target_def);
     obj->method         = method;
 
+    if (target == pa_object_property)
+        obj->key_id     = match_key_id(keys, obj->target_def);
+
 #ifdef DEBUG_MATCH
     pa_log_debug("new match: %s %s%s:%s %s", pa_policy_object_type_str(type),
                                              policy_object_target_str(target),
@@ -219,7 +237,7 @@ void pa_policy_match_free(pa_policy_match_object *obj)
         return;
 
     if (obj->method == pa_method_matches)
-        regfree(&obj->arg.rexp);
+        regex_free(obj->arg.regex);
 
     pa_xfree(obj->arg_def);
     pa_xfree(obj->target_def);
@@ -398,6 +416,15 @@ enum pa_classify_method pa_policy_match_method(pa_policy_match_object *obj)
     return obj->method;
 }
 
+const char *pa_policy_match_object_name(enum pa_policy_object_type type,
+                                        const void *obj)
+{
+    if (!obj)
+        return NULL;
+
+    return object_name(type, obj);
+}
+
 const char *pa_match_method_str(enum pa_classify_method method)
 {
     return method_str(method);
@@ -440,8 +467,14 @@ int pa_classify_method_matches(const char *string,
 
     found = false;
 
-    if (string && arg) {
-        if (regexec(&arg->rexp, string, MAX_MATCH, m, 0) == 0) {
+    if (string && arg && arg->regex) {
+        if (arg->regex->automaton &&
+            (found = regex_automaton_match(arg->regex, string)) >= 0)
+            return found;
+
+        found = false;
+
+        if (regexec(&arg->regex->rexp, string, MAX_MATCH, m, 0) == 0) {
             end = strlen(string);
 
             if (m[0].rm_so == 0 && m[0].rm_eo == end && m[1].rm_so == -1)
@@ -463,3 +496,407 @@ int pa_classify_method_true(const char *string,
 
     return true;
 }
+
+/*
+ * Property snapshots
+ *
+ * Every property name referenced by a match object gets a key id when
+ * the object is created. A snapshot caches the values of these keys of
+ * a single object, so evaluating many rules against the same object
+ * looks up each referenced property only once. The key ids live as
+ * long as the module, so match objects don't need to release them.
+ */
+
+struct pa_policy_match_keys {
+    pa_hashmap  *ids;           /* property name -> key id + 1 */
+    uint32_t     nkey;
+};
+
+static const char snapshot_unfetched[] = "";
+
+struct pa_policy_match_keys *pa_policy_match_keys_new(void)
+{
+    struct pa_policy_match_keys *keys;
+
+    keys = pa_xnew0(struct pa_policy_match_keys, 1);
+    keys->ids = pa_hashmap_new_full(pa_idxset_string_hash_func,
+                                    pa_idxset_string_compare_func,
+                                    pa_xfree, NULL);
+
+    return keys;
+}
+
+void pa_policy_match_keys_free(struct pa_policy_match_keys *keys)
+{
+    if (keys) {
+        pa_hashmap_free(keys->ids);
+        pa_xfree(keys);
+    }
+}
+
+static uint32_t match_key_id(struct pa_policy_match_keys *keys, const char *key)
+{
+    void *id;
+
+    if (!(id = pa_hashmap_get(keys->ids, key))) {
+        id = PA_UINT32_TO_PTR(++keys->nkey);
+        pa_hashmap_put(keys->ids, pa_xstrdup(key), id);
+    }
+
+    return PA_PTR_TO_UINT32(id) - 1;
+}
+
+void pa_policy_match_snapshot_init(struct pa_policy_match_snapshot *snap,
+                                   struct pa_policy_match_keys *keys,
+                                   enum pa_policy_object_type type,
+                                   const void *target)
+{
+    uint32_t i;
+
+    pa_assert(snap);
+    pa_assert(keys);
+
+    snap->type   = type;
+    snap->target = target;
+    snap->nkey   = keys->nkey;
+
+    if (snap->nkey <= PA_POLICY_MATCH_SNAPSHOT_KEYS)
+        snap->values = snap->local;
+    else
+        snap->values = pa_xnew(const char *, snap->nkey);
+
+    for (i = 0;  i < snap->nkey;  i++)
+        snap->values[i] = snapshot_unfetched;
+}
+
+void pa_policy_match_snapshot_done(struct pa_policy_match_snapshot *snap)
+{
+    pa_assert(snap);
+
+    if (snap->values != snap->local)
+        pa_xfree(snap->values);
+
+    snap->values = NULL;
+}
+
+bool pa_policy_match_snapshot(pa_policy_match_object *obj,
+                              struct pa_policy_match_snapshot *snap)
+{
+    const char *to_check;
+
+    pa_assert(obj);
+    pa_assert(snap);
+
+    /* keys created after the snapshot was taken are looked up directly */
+    if (obj->target != pa_object_property || obj->type != snap->type ||
+        obj->key_id >= snap->nkey || !snap->target)
+        return pa_policy_match(obj, snap->target);
+
+    if ((to_check = snap->values[obj->key_id]) == snapshot_unfetched)
+        to_check = snap->values[obj->key_id] = object_proplist_get(obj, snap->target);
+
+    return policy_match(obj, snap->target, to_check);
+}
+
+bool pa_policy_match_snapshot_type(pa_policy_match_object *obj,
+                                   struct pa_policy_match_snapshot *snap)
+{
+    pa_assert(obj);
+    pa_assert(snap);
+
+    if (obj->type != snap->type)
+        return false;
+
+    return pa_policy_match_snapshot(obj, snap);
+}
+
+/*
+ * Bit-parallel matcher for the 'matches' method
+ *
+ * Every position of the pattern (a literal, '.' or a bracket expression)
+ * is one bit of the state word, and each alternative is followed by an
+ * accepting bit. A set bit means the position is the next one to match.
+ * The pattern always has to match the whole string, so the anchors can
+ * be dropped.
+ */
+
+#define REGEX_MAX_BITS 64
+
+static int regex_bracket_parse(const char **pattern, uint64_t *chars, uint64_t bit)
+{
+    const unsigned char *p = (const unsigned char *) *pattern + 1;
+    bool     negate = false;
+    bool     set[256];
+    unsigned first, last;
+    int      c;
+
+    memset(set, 0, sizeof(set));
+
+    if (*p == '^') {
+        negate = true;
+        p++;
+    }
+
+    /* ']' is a literal as the first character of the list */
+    if (*p == ']')
+        set[*p++] = true;
+
+    while (*p != ']') {
+        if (*p == '\0' || *p >= 0x80)
+            return -1;
+
+        /* character classes, equivalence classes and collating symbols */
+        if (*p == '[' && (p[1] == ':' || p[1] == '=' || p[1] == '.'))
+            return -1;
+
+        first = *p++;
+
+        if (*p == '-' && p[1] != ']' && p[1] != '\0') {
+            if (p[1] == '[' || p[1] >= 0x80)
+                return -1;
+
+            last = p[1];
+            p += 2;
+
+            if (last < first)
+                return -1;
+        }
+        else
+            last = first;
+
+        for (c = first;  c <= (int) last;  c++)
+            set[c] = true;
+    }
+
+    for (c = 1;  c < 256;  c++) {
+        if (set[c] != negate)
+            chars[c] |= bit;
+    }
+
+    *pattern = (const char *) p + 1;
+
+    return 0;
+}
+
+static bool regex_automaton_compile(struct pa_classify_regex *re, const char *pattern)
+{
+    const char *p = pattern;
+    int         literal[REGEX_MAX_BITS];   /* literal char of a position or -1 */
+    uint64_t    bit;
+    unsigned    n = 0;                     /* bits used */
+    unsigned    first = 0;                 /* first bit of the alternative */
+    unsigned    nalt = 0;
+    unsigned    i, j;
+    size_t      len;
+    bool        atom = false;              /* previous position may repeat */
+    bool        begin = true;              /* at the beginning of an alternative */
+    int         c;
+
+    memset(re->chars, 0, sizeof(re->chars));
+    re->start = re->repeat = re->optional = re->accept = 0;
+    re->min_len = (size_t) -1;
+
+    for (;;) {
+        c = (unsigned char) *p;
+
+        if (begin && c == '^') {
+            begin = false;
+            p++;
+            continue;
+        }
+
+        begin = false;
+
+        if (c == '\0' || (c == '\\' && p[1] == '|')) {
+            if (n >= REGEX_MAX_BITS)
+                return false;
+
+            re->start  |= (uint64_t) 1 << first;
+            re->accept |= (uint64_t) 1 << n;
+
+            for (len = 0, i = first;  i < n;  i++) {
+                if (!(re->optional & ((uint64_t) 1 << i)))
+                    len++;
+            }
+            if (len < re->min_len)
+                re->min_len = len;
+
+            nalt++;
+            first = ++n;
+
+            if (c == '\0')
+                break;
+
+            p += 2;
+            atom = false;
+            begin = true;
+            continue;
+        }
+
+        if (c == '$' && (p[1] == '\0' || (p[1] == '\\' && p[2] == '|'))) {
+            p++;
+            continue;
+        }
+
+        if ((c == '*' && atom) || (c == '\\' && (p[1] == '+' || p[1] == '?'))) {
+            if (!atom)
+                return false;
+
+            bit = (uint64_t) 1 << (n - 1);
+            c   = (c == '*') ? '*' : p[1];
+            p  += (c == '*') ? 1 : 2;
+
+            /* combined repeats, e.g. 'a\+\?', end up as 'a*' */
+            if (c != '?')
+                re->repeat |= bit;
+            if (c != '+')
+                re->optional |= bit;
+
+            literal[n - 1] = -1;
+            continue;
+        }
+
+        if (n >= REGEX_MAX_BITS - 1)
+            return false;
+
+        bit = (uint64_t) 1 << n;
+        literal[n] = -1;
+
+        if (c == '.') {
+            for (i = 1;  i < 256;  i++)
+                re->chars[i] |= bit;
+            p++;
+        }
+        else if (c == '[') {
+            if (regex_bracket_parse(&p, re->chars, bit) < 0)
+                return false;
+        }
+        else {
+            if (c == '\\') {
+                c = (unsigned char) *++p;
+
+                /* groups, intervals, back-references, word operators, ... */
+                if (c == '\0' || isalnum(c) || strchr("(){}<>`'", c))
+                    return false;
+            }
+
+            if ((unsigned char) c >= 0x80)
+                return false;
+
+            re->chars[(unsigned char) c] |= bit;
+            literal[n] = c;
+            p++;
+        }
+
+        atom = true;
+        n++;
+    }
+
+    re->prefix_len = re->suffix_len = 0;
+
+    /* literal prefix and suffix of a single alternative for prefiltering */
+    if (nalt == 1) {
+        n--;
+
+        for (i = 0;  i < n && literal[i] >= 0;  i++)
+            ;
+        for (j = n;  j > i && literal[j - 1] >= 0;  j--)
+            ;
+
+        if (i > 0) {
+            re->prefix = pa_xnew(char, i + 1);
+            for (re->prefix_len = 0;  re->prefix_len < i;  re->prefix_len++)
+                re->prefix[re->prefix_len] = literal[re->prefix_len];
+            re->prefix[i] = '\0';
+        }
+
+        if (j < n) {
+            re->suffix = pa_xnew(char, n - j + 1);
+            for (re->suffix_len = 0;  j + re->suffix_len < n;  re->suffix_len++)
+                re->suffix[re->suffix_len] = literal[j + re->suffix_len];
+            re->suffix[re->suffix_len] = '\0';
+        }
+    }
+
+    return true;
+}
+
+static inline uint64_t regex_automaton_skip(struct pa_classify_regex *re, uint64_t state)
+{
+    uint64_t prev;
+
+    do {
+        prev   = state;
+        state |= (state & re->optional) << 1;
+    } while (state != prev);
+
+    return state;
+}
+
+/* returns -1 if the string needs to be matched by regexec() */
+static int regex_automaton_match(struct pa_classify_regex *re, const char *string)
+{
+    const unsigned char *s;
+    uint64_t state;
+    uint64_t hit;
+    size_t   len;
+
+    len = strlen(string);
+
+    if (len < re->min_len)
+        return false;
+
+    if (re->prefix_len && strncmp(string, re->prefix, re->prefix_len))
+        return false;
+
+    if (re->suffix_len && (len < re->suffix_len ||
+                           memcmp(string + len - re->suffix_len, re->suffix, re->suffix_len)))
+        return false;
+
+    state = regex_automaton_skip(re, re->start);
+
+    for (s = (const unsigned char *) string;  *s;  s++) {
+        /* multibyte characters depend on the locale */
+        if (*s >= 0x80)
+            return -1;
+
+        hit   = state & re->chars[*s];
+        state = regex_automaton_skip(re, (hit << 1) | (hit & re->repeat));
+
+        if (!state)
+            return false;
+    }
+
+    return (state & re->accept) ? true : false;
+}
+
+static struct pa_classify_regex *regex_new(const char *pattern)
+{
+    struct pa_classify_regex *re;
+
+    re = pa_xnew0(struct pa_classify_regex, 1);
+
+    if (regcomp(&re->rexp, pattern, 0) != 0) {
+        pa_xfree(re);
+        return NULL;
+    }
+
+    re->automaton = regex_automaton_compile(re, pattern);
+
+#ifdef DEBUG_MATCH
+    pa_log_debug("regex '%s' is run by %s", pattern,
+                 re->automaton ? "automaton" : "regexec");
+#endif
+
+    return re;
+}
+
+static void regex_free(struct pa_classify_regex *re)
+{
+    if (re) {
+        regfree(&re->rexp);
+        pa_xfree(re->prefix);
+        pa_xfree(re->suffix);
+        pa_xfree(re);
+    }
+}
@@ -2,6 +2,7 @@
 #define foopolicymatchfoo
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <regex.h>
 
 enum pa_policy_object_type {
@@ -39,9 +40,28 @@ enum pa_policy_object_target {
     pa_object_max
 };
 
-union pa_classify_arg {
-    char       *string;
+/* Regular expression of the 'matches' method. Patterns that only use
+ * literals, '.', bracket expressions, '*', '\+', '\?', '\|' and the
+ * anchors are run by a bit-parallel automaton; everything else is left
+ * to regexec(). */
+struct pa_classify_regex {
     regex_t     rexp;
+    bool        automaton;      /* pattern is run by the automaton */
+    uint64_t    chars[256];     /* positions accepting a character */
+    uint64_t    start;          /* first position of each alternative */
+    uint64_t    repeat;         /* positions that may repeat */
+    uint64_t    optional;       /* positions that may be skipped */
+    uint64_t    accept;         /* end of each alternative */
+    size_t      min_len;        /* shortest possible match */
+    char       *prefix;         /* literal prefix, if any */
+    size_t      prefix_len;
+    char       *suffix;         /* literal suffix, if any */
+    size_t      suffix_len;
+};
+
+union pa_classify_arg {
+    char                        *string;
+    struct pa_classify_regex    *regex;
 };
 
 struct pa_policy_match_object {
@@ -52,20 +72,42 @@ struct pa_policy_match_object {
     int                           (*func)(const char *, union pa_classify_arg *);
     union pa_classify_arg           arg;
     char                           *arg_def;
+    uint32_t                        key_id;     /* property key id, if any */
 };
 
 typedef struct pa_policy_match_object pa_policy_match_object;
 
+#define PA_POLICY_MATCH_SNAPSHOT_KEYS 16
+
+/* Property values of a single object, looked up at most once each while
+ * evaluating any number of match objects against the object. The object
+ * must not change while the snapshot is in use. */
+struct pa_policy_match_snapshot {
+    enum pa_policy_object_type      type;
+    const void                     *target;
+    uint32_t                        nkey;
+    const char                    **values;     /* indexed by key id */
+    const char                     *local[PA_POLICY_MATCH_SNAPSHOT_KEYS];
+};
+
+/* Property names referenced by match objects -> key ids, see snapshots */
+struct pa_policy_match_keys;
+
+struct pa_policy_match_keys *pa_policy_match_keys_new(void);
+void pa_policy_match_keys_free(struct pa_policy_match_keys *keys);
+
 pa_policy_match_object *pa_policy_match_string_new(enum pa_classify_method method,
                                                    const char *string);
 pa_policy_match_object *pa_policy_match_name_new(enum pa_policy_object_type type,
                                                  enum pa_classify_method method,
                                                  const char *arg);
-pa_policy_match_object *pa_policy_match_property_new(enum pa_policy_object_type type,
+pa_policy_match_object *pa_policy_match_property_new(struct pa_policy_match_keys *keys,
+                                                     enum pa_policy_object_type type,
                                                      const char *property_name,
                                                      enum pa_classify_method method,
                                                      const char *arg);
-pa_policy_match_object *pa_policy_match_new(enum pa_policy_object_type type,
+pa_policy_match_object *pa_policy_match_new(struct pa_policy_match_keys *keys,
+                                            enum pa_policy_object_type type,
                                             enum pa_policy_object_target target,
                                             const char *target_def,
                                             enum pa_classify_method method,
@@ -76,10 +118,23 @@ bool pa_policy_match_type(pa_policy_match_object *obj,
                           enum pa_policy_object_type expected_type,
                           const void *target);
 
+void pa_policy_match_snapshot_init(struct pa_policy_match_snapshot *snap,
+                                   struct pa_policy_match_keys *keys,
+                                   enum pa_policy_object_type type,
+                                   const void *target);
+void pa_policy_match_snapshot_done(struct pa_policy_match_snapshot *snap);
+bool pa_policy_match_snapshot(pa_policy_match_object *obj,
+                              struct pa_policy_match_snapshot *snap);
+bool pa_policy_match_snapshot_type(pa_policy_match_object *obj,
+                                   struct pa_policy_match_snapshot *snap);
+
 char *pa_policy_match_def(pa_policy_match_object *obj);
 const char *pa_policy_match_arg(pa_policy_match_object *obj);
 enum pa_classify_method pa_policy_match_method(pa_policy_match_object *obj);
 
+/* Name of the object as matched by pa_object_name targets */
+const char *pa_policy_match_object_name(enum pa_policy_object_type type,
+                                        const void *obj);
 const char *pa_match_method_str(enum pa_classify_method method);
 int   pa_classify_method_equals(const char *, union pa_classify_arg *);
 int   pa_classify_method_startswith(const char *, union pa_classify_arg *);
@@ -45,6 +45,8 @@
 #include "module-ext.h"
 #include "dbusif.h"
 #include "variable.h"
+#include "atom.h"
+#include "match.h"
 
 PA_MODULE_AUTHOR("Janos Kovacs");
 PA_MODULE_DESCRIPTION("Policy enforcement module");
@@ -128,6 +130,8 @@ int pa__init(pa_module *m) {
     m->userdata = u;
     u->core     = m->core;
     u->module   = m;
+    u->atoms    = pa_policy_atoms_new();
+    u->match_keys = pa_policy_match_keys_new();
     u->nullsink = pa_sink_ext_init_null_sink(nsnam);
     u->nullsource= pa_source_ext_init_null_source(nsource);
     u->hsnk     = pa_index_hash_init(8);
@@ -160,6 +164,8 @@ int pa__init(pa_module *m) {
     if (!pa_policy_parse_config_files(u, cfgfile, cfgdir))
         goto fail;
 
+    pa_policy_context_build_index(u);
+
     if (pa_policy_group_find(u, PA_POLICY_DEFAULT_GROUP_NAME) == NULL) {
         pa_log_debug("default group '%s' not defined, generating default group.", PA_POLICY_DEFAULT_GROUP_NAME);
         pa_policy_groupset_create_default_group(u, preempt);
@@ -222,6 +228,8 @@ void pa__done(pa_module *m) {
     pa_sink_ext_null_sink_free(u->nullsink);
     pa_source_ext_null_source_free(u->nullsource);
     pa_shared_data_unref(u->shared);
+    pa_policy_atoms_free(u->atoms);
+    pa_policy_match_keys_free(u->match_keys);
 
     
     pa_xfree(u);
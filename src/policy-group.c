@@ -5,6 +5,9 @@
 #include <pulsecore/namereg.h>
 #include <pulsecore/core-util.h>
 #include <pulse/volume.h>
+#include <pulse/rtclock.h>
+#include <pulsecore/module.h>
+#include <pulsecore/strbuf.h>
 
 #include "policy-group.h"
 #include "sink-ext.h"
@@ -16,6 +19,9 @@
 #include "variable.h"
 #include "context.h"
 #include "match.h"
+#include "atom.h"
+#include "card-ext.h"
+#include "index-hash.h"
 
 #define MUTE   1
 #define UNMUTE 0
@@ -38,6 +44,31 @@ struct cursor {
     struct pa_policy_group *grp;
 };
 
+struct counter {
+    const char *name;
+    int         offs;
+    bool        usec;
+};
+
+#define STATS_OFFSET(m) \
+    ((char *)&(((struct pa_policy_group_stats *)0)->m) - (char *)0)
+
+static const struct counter counters[] = {
+    { "sink_inputs_added"    , STATS_OFFSET(sinp_added)      , false },
+    { "sink_inputs_removed"  , STATS_OFFSET(sinp_removed)    , false },
+    { "source_outputs_added" , STATS_OFFSET(sout_added)      , false },
+    { "source_outputs_removed", STATS_OFFSET(sout_removed)   , false },
+    { "moves"                , STATS_OFFSET(moves)           , false },
+    { "failed_moves"         , STATS_OFFSET(failed_moves)    , false },
+    { "corks"                , STATS_OFFSET(corks)           , false },
+    { "uncorks"              , STATS_OFFSET(uncorks)         , false },
+    { "mutes_by_route"       , STATS_OFFSET(mutes_by_route)  , false },
+    { "unmutes_by_route"     , STATS_OFFSET(unmutes_by_route), false },
+    { "volume_limit_changes" , STATS_OFFSET(limit_changes)   , false },
+    { "move_usec"            , STATS_OFFSET(move_usec)       , true  },
+    { NULL                   , 0                             , false }
+};
+
 
 static struct pa_sink   *defsink;
 static struct pa_source *defsource;
@@ -45,7 +76,13 @@ static uint32_t          defsinkidx = PA_IDXSET_INVALID;
 static uint32_t          defsrcidx  = PA_IDXSET_INVALID;
 static pa_volume_t       dbtbl[300];
 
-static int move_group(struct pa_policy_group *, struct target *);
+static int move_group(struct userdata *, struct pa_policy_group *,
+                      struct target *);
+static int group_move_sink_inputs(struct userdata *, struct pa_policy_group *,
+                                  struct pa_sink *);
+static int group_move_source_outputs(struct userdata *,
+                                     struct pa_policy_group *,
+                                     struct pa_source *);
 static int volset_group(struct userdata *, struct pa_policy_group *,
                         pa_volume_t);
 static int mute_group_by_route(struct userdata *u, struct pa_policy_group *, int);
@@ -60,7 +97,25 @@ static struct pa_policy_group *find_group_by_name(struct pa_policy_groupset *,
 static struct pa_sink   *find_sink_by_type(struct userdata *, const char *);
 static struct pa_source *find_source_by_type(struct userdata *, const char *);
 
-static uint32_t hash_value(const char *);
+static uint32_t hash_value(const char *atom);
+
+static uint64_t counter_value(struct pa_policy_group *,
+                              const struct counter *);
+static void sink_input_list_link(struct pa_policy_group *,
+                                 struct pa_sink_input_list *);
+static void sink_input_list_unlink(struct pa_sink_input_list *);
+static void source_output_list_link(struct pa_policy_group *,
+                                    struct pa_source_output_list *);
+static void source_output_list_unlink(struct pa_source_output_list *);
+static bool group_sink_is_running(struct userdata *, struct pa_policy_group *);
+static void group_set_sink(struct pa_policy_groupset *,
+                           struct pa_policy_group *, struct pa_sink *);
+static void group_set_source(struct pa_policy_groupset *,
+                             struct pa_policy_group *, struct pa_source *);
+static struct pa_policy_group *groups_of_sink(struct pa_policy_groupset *,
+                                              uint32_t);
+static struct pa_policy_group *groups_of_source(struct pa_policy_groupset *,
+                                                uint32_t);
 
 
 struct pa_policy_groupset *pa_policy_groupset_new(struct userdata *u)
@@ -83,6 +138,10 @@ struct pa_policy_groupset *pa_policy_groupset_new(struct userdata *u)
     }
     
     gset = pa_xnew0(struct pa_policy_groupset, 1);
+    gset->atoms = u->atoms;
+    gset->soutidx = pa_index_hash_init(8);
+    gset->sinkgrps = pa_index_hash_init(6);
+    gset->srcgrps = pa_index_hash_init(6);
 
     return gset;
 }
@@ -91,6 +150,9 @@ void pa_policy_groupset_free(struct pa_policy_groupset *gset)
 {
     pa_assert(gset);
 
+    pa_index_hash_free(gset->soutidx);
+    pa_index_hash_free(gset->sinkgrps);
+    pa_index_hash_free(gset->srcgrps);
     pa_xfree(gset);
 }
 
@@ -98,6 +160,7 @@ void pa_policy_groupset_update_default_sink(struct userdata *u, uint32_t idx)
 {
     struct pa_policy_groupset *gset;
     struct pa_policy_group    *group;
+    struct pa_policy_group    *next;
     const char                *defsinkname;
     int                        i;
 
@@ -112,15 +175,11 @@ void pa_policy_groupset_update_default_sink(struct userdata *u, uint32_t idx)
     if (defsink != NULL && defsinkidx == idx) {
         pa_log_debug("Unset default sink (idx=%d)", idx);
 
-        for (i = 0;   i < PA_POLICY_GROUP_HASH_DIM;   i++) {
-            for (group = gset->hash_tbl[i]; group; group = group->next) {
-                if (group->sinkidx == defsinkidx) {
-                    pa_log_debug("  unset default sink for group '%s'",
-                                 group->name);
-                    group->sink = NULL;
-                    group->sinkidx = PA_IDXSET_INVALID;
-                }
-            }
+        for (group = groups_of_sink(gset, defsinkidx);  group;  group = next) {
+            next = group->sink_next;
+
+            pa_log_debug("  unset default sink for group '%s'", group->name);
+            group_set_sink(gset, group, NULL);
         }
         
         defsink = NULL;
@@ -146,8 +205,7 @@ void pa_policy_groupset_update_default_sink(struct userdata *u, uint32_t idx)
                     if (group->sinkname == NULL && group->sink == NULL) {
                         pa_log_debug("  set sink '%s' as default for "
                                      "group '%s'", defsinkname, group->name);
-                        group->sink = defsink;
-                        group->sinkidx = defsinkidx;
+                        group_set_sink(gset, group, defsink);
 
                         /* TODO: we should move the streams to defsink */
                     }
@@ -186,8 +244,7 @@ static void policy_groupset_register_sink(struct userdata *u,
                     pa_log_debug("  set sink '%s' as default for group '%s'",
                                  sinkname, group->name);
 
-                    group->sink    = sink;
-                    group->sinkidx = sinkidx;
+                    group_set_sink(gset, group, sink);
 
                     /* TODO: we should move the streams to the sink */
                 }
@@ -205,25 +262,21 @@ void pa_policy_groupset_unregister_sink(struct userdata *u, uint32_t sinkidx)
 {
     struct pa_policy_groupset *gset;
     struct pa_policy_group    *group;
-    int                        i;
+    struct pa_policy_group    *next;
 
     pa_assert(u);
     pa_assert_se((gset = u->groups));
 
     pa_log_debug("Unregister sink (idx=%d)", sinkidx);
         
-    for (i = 0;   i < PA_POLICY_GROUP_HASH_DIM;   i++) {
-        for (group = gset->hash_tbl[i];    group;    group = group->next) {
-            if (group->sinkidx == sinkidx) {
-                pa_log_debug("  unset default sink for group '%s'",
-                             group->name);
+    for (group = groups_of_sink(gset, sinkidx);  group;  group = next) {
+        next = group->sink_next;
 
-                group->sink    = NULL;
-                group->sinkidx = PA_IDXSET_INVALID;
+        pa_log_debug("  unset default sink for group '%s'", group->name);
 
-                /* TODO: we should move the streams to somewhere */
-            }
-        }
+        group_set_sink(gset, group, NULL);
+
+        /* TODO: we should move the streams to somewhere */
     }
 }
 
@@ -264,8 +317,7 @@ static void policy_groupset_register_source(struct userdata *u,
                     pa_log_debug("  set source '%s' as default for group '%s'",
                                  srcname, group->name);
 
-                    group->source = source;
-                    group->srcidx = srcidx;
+                    group_set_source(gset, group, source);
 
                     /* TODO: we should move the streams to the source */
                 }
@@ -284,25 +336,21 @@ void pa_policy_groupset_unregister_source(struct userdata *u, uint32_t srcidx)
 {
     struct pa_policy_groupset *gset;
     struct pa_policy_group    *group;
-    int                        i;
+    struct pa_policy_group    *next;
 
     pa_assert(u);
     pa_assert_se((gset = u->groups));
 
     pa_log_debug("Unregister source (idx=%d)", srcidx);
         
-    for (i = 0;   i < PA_POLICY_GROUP_HASH_DIM;   i++) {
-        for (group = gset->hash_tbl[i];    group;    group = group->next) {
-            if (group->srcidx == srcidx) {
-                pa_log_debug("  unset default source for group '%s'",
-                             group->name);
+    for (group = groups_of_source(gset, srcidx);  group;  group = next) {
+        next = group->src_next;
+
+        pa_log_debug("  unset default source for group '%s'", group->name);
 
-                group->source = NULL;
-                group->srcidx = PA_IDXSET_INVALID;
+        group_set_source(gset, group, NULL);
                 
-                /* TODO: we should move the streams to the somwhere */
-            }
-        }
+        /* TODO: we should move the streams to the somwhere */
     }
 }
 
@@ -344,11 +392,13 @@ void pa_policy_groupset_create_default_group(struct userdata *u,
 int pa_policy_groupset_restore_volume(struct userdata *u, struct pa_sink *sink)
 {
     struct pa_policy_group *group;
-    struct cursor           cursor = { .idx = 0, .grp = NULL, };
     int ret = 0;
 
     if (sink) {
-        while ((group = group_scan(u->groups, &cursor)) != NULL) {
+        for (group = groups_of_sink(u->groups, sink->index);
+             group != NULL;
+             group = group->sink_next)
+        {
             if (sink == group->sink) {
                 if (mute_group_locally(u, group, UNMUTE) < 0)
                     ret = -1;
@@ -359,6 +409,39 @@ int pa_policy_groupset_restore_volume(struct userdata *u, struct pa_sink *sink)
     return ret;
 }
 
+/* Refresh the sink_active bit of the dynamic sink groups the given sink
+ * may be the sink of. Called when a sink appears, disappears or changes
+ * state, so stream classification can rely on the bit. */
+void pa_policy_groupset_update_sink_active(struct userdata *u, struct pa_sink *sink)
+{
+    struct pa_policy_groupset *gset;
+    struct pa_policy_group    *group;
+    bool                       active;
+    int                        i;
+
+    pa_assert(u);
+    pa_assert(sink);
+    pa_assert_se((gset = u->groups));
+
+    for (i = 0;   i < PA_POLICY_GROUP_HASH_DIM;   i++) {
+        for (group = gset->hash_tbl[i];    group;    group = group->next) {
+            if (!(group->flags & PA_POLICY_GROUP_FLAG_DYNAMIC_SINK))
+                continue;
+
+            if (!group->sink_match || !pa_policy_match(group->sink_match, sink))
+                continue;
+
+            active = group_sink_is_running(u, group);
+
+            if (active != group->sink_active) {
+                pa_log_debug("sink of group '%s' is %srunning", group->name,
+                             active ? "" : "not ");
+                group->sink_active = active;
+            }
+        }
+    }
+}
+
 struct pa_policy_group *pa_policy_group_new(struct userdata *u, const char *name,
                                             const char *sinkname,
                                             enum pa_classify_method sink_method,
@@ -384,6 +467,8 @@ struct pa_policy_group *pa_policy_group_new(struct userdata *u, const char *name
     pa_policy_var_update(u, sinkname);
     pa_policy_var_update(u, srcname);
 
+    name = pa_policy_atom(u->atoms, name);
+
     if ((group = find_group_by_name(gset, name, &idx)) != NULL)
         return group;
 
@@ -393,7 +478,7 @@ struct pa_policy_group *pa_policy_group_new(struct userdata *u, const char *name
         obj_target = pa_safe_streq(sink_prop, "(name)") ? pa_object_name : pa_object_property;
         if (obj_target == pa_object_name)
             sink_prop = NULL;
-        group->sink_match = pa_policy_match_new(pa_policy_object_sink,
+        group->sink_match = pa_policy_match_new(u->match_keys, pa_policy_object_sink,
                                                 obj_target,
                                                 pa_policy_var(u, sink_prop),
                                                 sink_method,
@@ -409,7 +494,7 @@ struct pa_policy_group *pa_policy_group_new(struct userdata *u, const char *name
         obj_target = pa_safe_streq(source_prop, "(name)") ? pa_object_name : pa_object_property;
         if (obj_target == pa_object_name)
             source_prop = NULL;
-        group->src_match = pa_policy_match_new(pa_policy_object_source,
+        group->src_match = pa_policy_match_new(u->match_keys, pa_policy_object_source,
                                                obj_target,
                                                pa_policy_var(u, source_prop),
                                                source_method,
@@ -423,17 +508,19 @@ struct pa_policy_group *pa_policy_group_new(struct userdata *u, const char *name
 
     group->next     = gset->hash_tbl[idx];
     group->flags    = flags;
-    group->name     = pa_xstrdup(name);
+    group->name     = name;
     group->limit    = PA_VOLUME_NORM;
 
     group->sinkname = sinkname ? pa_xstrdup(sinkname) : NULL;
-    group->sink     = sinkname ? NULL : defsink;
-    group->sinkidx  = sinkname ? PA_IDXSET_INVALID : defsinkidx;
+    group->sinkidx  = PA_IDXSET_INVALID;
+    group_set_sink(gset, group, sinkname ? NULL : defsink);
 
     group->srcname  = srcname  ? pa_xstrdup(srcname) : NULL;
-    group->source   = srcname  ? NULL : defsource;
-    group->srcidx   = srcname  ? PA_IDXSET_INVALID : defsrcidx;
+    group->srcidx   = PA_IDXSET_INVALID;
+    group_set_source(gset, group, srcname ? NULL : defsource);
     group->properties = properties;
+    group->sink_active = !(flags & PA_POLICY_GROUP_FLAG_DYNAMIC_SINK) ||
+                         group_sink_is_running(u, group);
 
     gset->hash_tbl[idx] = group;
 
@@ -461,7 +548,7 @@ void pa_policy_group_free(struct pa_policy_groupset *gset, const char *name)
     struct pa_source_output      *sout;
     struct pa_source_output_list *sol;
     struct pa_source_output_list *nxtso;
-    char                         *dnam;
+    const char                   *dnam;
     uint32_t                      idx;
 
     pa_assert(gset);
@@ -487,6 +574,9 @@ void pa_policy_group_free(struct pa_policy_groupset *gset, const char *name)
 
                             pa_sink_input_ext_set_policy_group(sinp, NULL);
 
+                            if (sil->ext)
+                                sil->ext->member = NULL;
+
                             pa_xfree(sil);
                         }
                     }
@@ -498,11 +588,15 @@ void pa_policy_group_free(struct pa_policy_groupset *gset, const char *name)
 
                         for (sil = group->sinpls;   sil;   sil = sil->next) {
                             sinp = sil->sink_input;
+                            sil->group = dflt;
 
                             pa_sink_input_ext_set_policy_group(sinp, dnam);
                             
-                            if (sil->next == NULL)
-                                sil->next = dflt->sinpls;
+                            if (sil->next == NULL) {
+                                if ((sil->next = dflt->sinpls) != NULL)
+                                    dflt->sinpls->prev = sil;
+                                break;
+                            }
                         }
                         
                         dflt->sinpls = group->sinpls;
@@ -515,12 +609,15 @@ void pa_policy_group_free(struct pa_policy_groupset *gset, const char *name)
                         sout  = sol->source_output;
 
                         pa_source_output_ext_set_policy_group(sout, NULL);
+                        pa_index_hash_remove(gset->soutidx, sol->index);
 
                         pa_xfree(sol);
                     }
                 } /* if group->soutls */
 
-                pa_xfree(group->name);
+                group_set_sink(gset, group, NULL);
+                group_set_source(gset, group, NULL);
+
                 pa_xfree(group->sinkname);
                 pa_xfree(group->portname);
                 pa_policy_match_free(group->sink_match);
@@ -528,6 +625,7 @@ void pa_policy_group_free(struct pa_policy_groupset *gset, const char *name)
                 pa_policy_match_free(group->src_match);
                 if (group->properties)
                     pa_proplist_free(group->properties);
+                pa_xfree(group->stats_exported);
 
                 prev->next = group->next;
 
@@ -551,6 +649,89 @@ struct pa_policy_group *pa_policy_group_find(struct userdata *u,
     return find_group_by_name(gset, name, NULL);
 }
 
+struct pa_policy_group *pa_policy_group_next(struct userdata        *u,
+                                             struct pa_policy_group *group)
+{
+    struct pa_policy_groupset *gset;
+    uint32_t                   idx;
+
+    pa_assert(u);
+    pa_assert_se((gset = u->groups));
+
+    if (group == NULL)
+        idx = 0;
+    else if (group->next != NULL)
+        return group->next;
+    else
+        idx = hash_value(group->name) + 1;
+
+    for (;  idx < PA_POLICY_GROUP_HASH_DIM;  idx++) {
+        if (gset->hash_tbl[idx] != NULL)
+            return gset->hash_tbl[idx];
+    }
+
+    return NULL;
+}
+
+void pa_policy_group_stats_foreach(struct pa_policy_group *group,
+                                   void (*cb)(const char *, uint64_t, void *),
+                                   void *data)
+{
+    const struct counter *c;
+
+    pa_assert(group);
+    pa_assert(cb);
+
+    for (c = counters;  c->name;  c++)
+        cb(c->name, counter_value(group, c), data);
+}
+
+void pa_policy_groupset_export_stats(struct userdata *u)
+{
+    struct pa_policy_group *group;
+    const struct counter   *c;
+    pa_proplist            *proplist;
+    pa_strbuf              *buf;
+    char                    key[256];
+    char                   *value;
+
+    pa_assert(u);
+    pa_assert(u->module);
+
+    proplist = pa_proplist_new();
+
+    for (group = pa_policy_group_next(u, NULL);  group;
+         group = pa_policy_group_next(u, group))
+    {
+        buf = pa_strbuf_new();
+
+        for (c = counters;  c->name;  c++) {
+            pa_strbuf_printf(buf, "%s%s=%llu", c == counters ? "" : " ",
+                             c->name,
+                             (unsigned long long) counter_value(group, c));
+        }
+
+        value = pa_strbuf_to_string_free(buf);
+
+        /* every property update is a subscription event for all clients */
+        if (group->stats_exported && !strcmp(group->stats_exported, value)) {
+            pa_xfree(value);
+            continue;
+        }
+
+        snprintf(key, sizeof(key), PA_PROP_POLICY_GROUP_STATS, group->name);
+        pa_proplist_sets(proplist, key, value);
+
+        pa_xfree(group->stats_exported);
+        group->stats_exported = value;
+    }
+
+    if (!pa_proplist_isempty(proplist))
+        pa_module_update_proplist(u->module, PA_UPDATE_REPLACE, proplist);
+
+    pa_proplist_free(proplist);
+}
+
 void pa_policy_group_insert_sink_input(struct userdata      *u,
                                        const char           *name,
                                        struct pa_sink_input *si,
@@ -570,7 +751,6 @@ void pa_policy_group_insert_sink_input(struct userdata      *u,
     int                        local_route;
     int                        local_mute;
     int                        static_route;
-    struct cursor              cursor = { .idx = 0, .grp = NULL, };
 
     pa_assert(u);
     pa_assert_se((gset = u->groups));
@@ -585,11 +765,13 @@ void pa_policy_group_insert_sink_input(struct userdata      *u,
         pa_sink_input_ext_set_policy_group(si, group->name);
 
         sl = pa_xnew0(struct pa_sink_input_list, 1);
-        sl->next = group->sinpls;
         sl->index = si->index;
         sl->sink_input = si;
 
-        group->sinpls = sl;
+        if ((sl->ext = pa_sink_input_ext_lookup(u, si)) != NULL)
+            sl->ext->member = sl;
+
+        sink_input_list_link(group, sl);
 
         if (group->sink != NULL) {
             sinp_name = pa_sink_input_ext_get_name(si);
@@ -601,18 +783,36 @@ void pa_policy_group_insert_sink_input(struct userdata      *u,
             if (group->mutebyrt_sink & !local_route) {
                 ns = u->nullsink;
 
-                pa_log_debug("move sink input '%s' to sink '%s'",
-                             sinp_name, ns->name);
+                /* pa_sink_input_move_to() is a no-op for the current sink;
+                 * checking here keeps it out of the move counters */
+                if (si->sink == ns->sink)
+                    pa_log_debug("sink input '%s' already on sink '%s'",
+                                 sinp_name, ns->name);
+                else {
+                    pa_log_debug("move sink input '%s' to sink '%s'",
+                                 sinp_name, ns->name);
 
-                pa_sink_input_move_to(si, ns->sink, true);
+                    if (pa_sink_input_move_to(si, ns->sink, true) < 0)
+                        group->stats.failed_moves++;
+                    else
+                        group->stats.moves++;
+                }
             }
             else if (group->flags & route_flags) {
                 static_route = ((group->flags & route_flags) == setsink_flag);
 
-                pa_log_debug("move stream '%s'/'%s' to sink '%s'",
-                             group->name, sinp_name, sink_name);
+                if (si->sink == group->sink)
+                    pa_log_debug("stream '%s'/'%s' already on sink '%s'",
+                                 group->name, sinp_name, sink_name);
+                else {
+                    pa_log_debug("move stream '%s'/'%s' to sink '%s'",
+                                 group->name, sinp_name, sink_name);
 
-                pa_sink_input_move_to(si, group->sink, true);
+                    if (pa_sink_input_move_to(si, group->sink, true) < 0)
+                        group->stats.failed_moves++;
+                    else
+                        group->stats.moves++;
+                }
 
                 if (local_route && group->portname && static_route) {
                     pa_sink_ext_override_port(u, group->sink, group->portname);
@@ -626,7 +826,7 @@ void pa_policy_group_insert_sink_input(struct userdata      *u,
             }
 
             if (local_mute) {
-                while ((g = group_scan(u->groups, &cursor)) != NULL){
+                for (g = groups_of_sink(gset, group->sinkidx);  g;  g = g->sink_next) {
                     if (g->sink && g->sink == group->sink) {
                         mute_group_locally(u, g, MUTE);
                     }
@@ -641,6 +841,7 @@ void pa_policy_group_insert_sink_input(struct userdata      *u,
         }
 
         group->sinpcnt++;
+        group->stats.sinp_added++;
 
         if ((group->flags & PA_POLICY_GROUP_FLAG_MEDIA_NOTIFY) &&
             group->sinpcnt == 1)
@@ -661,52 +862,47 @@ void pa_policy_group_remove_sink_input(struct userdata *u, uint32_t idx)
 {
     static const char         *media = "audio_playback";
     struct pa_policy_group    *group;
-    struct pa_sink_input_list *prev;
+    struct pa_sink_input_ext  *ext;
     struct pa_sink_input_list *sl;
-    struct cursor              cursor = { .idx = 0, .grp = NULL, };
 
     pa_assert(u);
     pa_assert(u->groups);
 
-    while ((group = group_scan(u->groups, &cursor)) != NULL) {
-        for (prev = (struct pa_sink_input_list *)&group->sinpls;
-             prev != NULL;
-             prev = prev->next)
-        {
-            if ((sl = prev->next) != NULL && idx == sl->index) {
-
-                group->sinpcnt--;
+    if (!(ext = pa_index_hash_lookup(u->hsi, idx)) || !(sl = ext->member)) {
+        pa_log("Can't remove sink input (idx=%d): not a member of any group",
+               idx);
+        return;
+    }
 
-                if (group->num_moving > 0 && !sl->sink_input->sink) {
-                    pa_log_info("Removing a moving sink input %s",
-                                pa_sink_input_ext_get_name(sl->sink_input));
-                    group->num_moving--;
-                }
+    pa_assert_se((group = sl->group));
 
-                if ((group->flags & PA_POLICY_GROUP_FLAG_MEDIA_NOTIFY) &&
-                    group->sinpcnt < 1)
-                {
-                    group->sinpcnt = 0;
+    group->sinpcnt--;
+    group->stats.sinp_removed++;
 
-                    pa_log_debug("media notification: group '%s' media '%s' "
-                                 "state 'inactive'", group->name, media);
+    if (group->num_moving > 0 && !sl->sink_input->sink) {
+        pa_log_info("Removing a moving sink input %s",
+                    pa_sink_input_ext_get_name(sl->sink_input));
+        group->num_moving--;
+    }
 
-                    pa_policy_dbusif_send_media_status(u, media,group->name,0);
-                }
+    if ((group->flags & PA_POLICY_GROUP_FLAG_MEDIA_NOTIFY) &&
+        group->sinpcnt < 1)
+    {
+        group->sinpcnt = 0;
 
-                prev->next = sl->next;
+        pa_log_debug("media notification: group '%s' media '%s' "
+                     "state 'inactive'", group->name, media);
 
-                pa_xfree(sl);
+        pa_policy_dbusif_send_media_status(u, media,group->name,0);
+    }
 
-                pa_log_debug("sink input (idx=%d) removed from group '%s'",
-                             idx, group->name);
+    sink_input_list_unlink(sl);
+    ext->member = NULL;
 
-                return;
-            }
-        }
-    }
+    pa_xfree(sl);
 
-    pa_log("Can't remove sink input (idx=%d): not a member of any group", idx);
+    pa_log_debug("sink input (idx=%d) removed from group '%s'",
+                 idx, group->name);
 }
 
 void pa_policy_group_insert_source_output(struct userdata         *u,
@@ -740,11 +936,11 @@ void pa_policy_group_insert_source_output(struct userdata         *u,
         pa_source_output_ext_set_policy_group(so, group->name);
 
         sl = pa_xnew0(struct pa_source_output_list, 1);
-        sl->next = group->soutls;
         sl->index = so->index;
         sl->source_output = so;
 
-        group->soutls = sl;
+        source_output_list_link(group, sl);
+        pa_index_hash_add(gset->soutidx, so->index, sl);
         ns = u->nullsource;
 
         if (group->mutebyrt_source && ns->source) {
@@ -752,7 +948,10 @@ void pa_policy_group_insert_source_output(struct userdata         *u,
             pa_log_debug("move source output '%s' to source '%s'",
                          sout_name, ns->name);
 
-            pa_source_output_move_to(so, ns->source, true);
+            if (pa_source_output_move_to(so, ns->source, true) < 0)
+                group->stats.failed_moves++;
+            else
+                group->stats.moves++;
         } else if (group->source != NULL) {
             sout_name = pa_source_output_ext_get_name(so);
             src_name  = pa_source_ext_get_name(group->source);
@@ -761,11 +960,15 @@ void pa_policy_group_insert_source_output(struct userdata         *u,
                 pa_log_debug("move source output '%s' to source '%s'",
                              sout_name, src_name);
 
-                pa_source_output_move_to(so, group->source, true);
+                if (pa_source_output_move_to(so, group->source, true) < 0)
+                    group->stats.failed_moves++;
+                else
+                    group->stats.moves++;
             }
         }
 
         group->soutcnt++;
+        group->stats.sout_added++;
 
         if ((group->flags & PA_POLICY_GROUP_FLAG_MEDIA_NOTIFY) &&
             group->soutcnt == 1)
@@ -787,52 +990,45 @@ void pa_policy_group_remove_source_output(struct userdata *u, uint32_t idx)
     static const char  *media       = "audio_recording";
 
     struct pa_policy_group       *group;
-    struct pa_source_output_list *prev;
     struct pa_source_output_list *sl;
-    struct cursor                 cursor = { .idx = 0, .grp = NULL, };
 
     pa_assert(u);
     pa_assert(u->groups);
 
-    while ((group = group_scan(u->groups, &cursor)) != NULL) {
-        for (prev = (struct pa_source_output_list *)&group->soutls;
-             prev != NULL;
-             prev = prev->next)
-        {
-            if ((sl = prev->next) != NULL && idx == sl->index) {
-                group->soutcnt--;
+    if (!(sl = pa_index_hash_remove(u->groups->soutidx, idx))) {
+        pa_log("Can't remove source output (idx=%d): not a member of any "
+               "group", idx);
+        return;
+    }
 
-                if (group->num_moving > 0 && !sl->source_output->source) {
-                    pa_log_info("Removing a moving source output %s",
-                                pa_source_output_ext_get_name(sl->source_output));
-                    group->num_moving--;
-                }
+    pa_assert_se((group = sl->group));
 
-                if ((group->flags & PA_POLICY_GROUP_FLAG_MEDIA_NOTIFY) &&
-                    group->soutcnt < 1)
-                {
-                    group->soutcnt = 0;
+    group->soutcnt--;
+    group->stats.sout_removed++;
 
-                    pa_log_debug("media notification: group '%s' media '%s' "
-                                 "state 'inactive'", group->name, media);
+    if (group->num_moving > 0 && !sl->source_output->source) {
+        pa_log_info("Removing a moving source output %s",
+                    pa_source_output_ext_get_name(sl->source_output));
+        group->num_moving--;
+    }
 
-                    pa_policy_dbusif_send_media_status(u, media,group->name,0);
-                }
+    if ((group->flags & PA_POLICY_GROUP_FLAG_MEDIA_NOTIFY) &&
+        group->soutcnt < 1)
+    {
+        group->soutcnt = 0;
 
-                prev->next = sl->next;
+        pa_log_debug("media notification: group '%s' media '%s' "
+                     "state 'inactive'", group->name, media);
 
-                pa_xfree(sl);
+        pa_policy_dbusif_send_media_status(u, media,group->name,0);
+    }
 
-                pa_log_debug("source output (idx=%d) removed from group '%s'",
-                             idx, group->name);
+    source_output_list_unlink(sl);
 
-                return;
-            }
-        }
-    }
+    pa_xfree(sl);
 
-    pa_log("Can't remove source output (idx=%d): "
-           "not a member of any group", idx);
+    pa_log_debug("source output (idx=%d) removed from group '%s'",
+                 idx, group->name);
 }
 
 int pa_policy_group_move_to(struct userdata *u, const char *name,
@@ -881,7 +1077,7 @@ int pa_policy_group_move_to(struct userdata *u, const char *name,
                 if (!(grp->flags & PA_POLICY_GROUP_FLAG_ROUTE_AUDIO))
                     ret = 0;
                 else
-                    ret = move_group(grp, &target) == 0 ? 1 : -1;
+                    ret = move_group(u, grp, &target) == 0 ? 1 : -1;
             }
         }
         else {                  /* move all groups */
@@ -889,7 +1085,7 @@ int pa_policy_group_move_to(struct userdata *u, const char *name,
 
            while ((grp = group_scan(u->groups, &cursor)) != NULL) {
                 if ((grp->flags & PA_POLICY_GROUP_FLAG_ROUTE_AUDIO)) {
-                    if (move_group(grp, &target) < 0)
+                    if (move_group(u, grp, &target) < 0)
                         ret = -1;
                     else
                         ret++;
@@ -920,41 +1116,79 @@ int pa_policy_group_move_to(struct userdata *u, const char *name,
     return ret;
 }
 
-static int start_move_group(struct pa_policy_group *group)
+static bool card_is_changing(struct pa_card *card, struct pa_card **cards,
+                             int ncard)
 {
-    struct pa_sink_input_list    *input  = NULL;
-    struct pa_source_output_list *output = NULL;
+    int i;
 
-    pa_assert(group);
+    if (card != NULL) {
+        for (i = 0;  i < ncard;  i++) {
+            if (cards[i] == card)
+                return true;
+        }
+    }
+
+    return false;
+}
+
+static int start_move_sink_inputs(struct pa_policy_group *group,
+                                  struct pa_sink *target,
+                                  struct pa_card **cards, int ncard)
+{
+    struct pa_sink_input_list *input;
+    struct pa_sink_input      *sinp;
+    bool                       retarget;
+    int                        n = 0;
 
-    if (group->num_moving > 0)
-        pa_log_error("Starting to move group %s which already has moving streams", group->name);
+    /* if the target can't be resolved before the switch, move everything */
+    retarget = !target || target != group->sink;
 
     for (input = group->sinpls; input; input = input->next) {
-        if (!input->sink_input->sink)
-            pa_log_error("Sink input %s already detached",
-                    pa_sink_input_ext_get_name(input->sink_input));
-        else {
+        sinp = input->sink_input;
+
+        /* already detached by an earlier routing decision */
+        if (!sinp->sink)
+            continue;
+
+        if (retarget || card_is_changing(sinp->sink->card, cards, ncard)) {
             pa_log_debug("Starting to move sink input %s",
-                    pa_sink_input_ext_get_name(input->sink_input));
-            pa_assert_se(pa_sink_input_start_move(input->sink_input) >= 0);
+                    pa_sink_input_ext_get_name(sinp));
+            pa_assert_se(pa_sink_input_start_move(sinp) >= 0);
             group->num_moving++;
+            n++;
         }
     }
 
+    return n;
+}
+
+static int start_move_source_outputs(struct pa_policy_group *group,
+                                     struct pa_source *target,
+                                     struct pa_card **cards, int ncard)
+{
+    struct pa_source_output_list *output;
+    struct pa_source_output      *sout;
+    bool                          retarget;
+    int                           n = 0;
+
+    retarget = !target || target != group->source;
+
     for (output = group->soutls; output; output = output->next) {
-        if (!output->source_output->source)
-            pa_log_error("Source output %s already detached",
-                    pa_source_output_ext_get_name(output->source_output));
-        else {
+        sout = output->source_output;
+
+        if (!sout->source)
+            continue;
+
+        if (retarget || card_is_changing(sout->source->card, cards, ncard)) {
             pa_log_debug("Starting to move source output %s",
-                    pa_source_output_ext_get_name(output->source_output));
-            pa_assert_se(pa_source_output_start_move(output->source_output) >= 0);
+                    pa_source_output_ext_get_name(sout));
+            pa_assert_se(pa_source_output_start_move(sout) >= 0);
             group->num_moving++;
+            n++;
         }
     }
 
-    return 0;
+    return n;
 }
 
 void pa_policy_group_assert_moving(struct userdata *u)
@@ -985,23 +1219,90 @@ void pa_policy_group_assert_moving(struct userdata *u)
     }
 }
 
-int pa_policy_group_start_move_all(struct userdata *u)
+int pa_policy_group_start_move(struct userdata *u,
+                               enum pa_policy_route_class class,
+                               const char *type)
 {
     struct pa_policy_group *group = NULL;
     struct cursor           cursor = { .idx = 0, .grp = NULL, };
-    int ret = 0;
+    struct pa_card         *cards[PA_POLICY_CARD_MAX_DEFS];
+    struct pa_sink         *sink;
+    struct pa_source       *source;
+    int                     ncard;
+    int                     nstream = 0;
 
     pa_assert(u);
+    pa_assert(type);
+
+    /*
+     * Streams are left attached when the switch leaves them where they
+     * are: their group keeps its sink (source) and the card of the sink
+     * (source) they are on keeps its profile.
+     */
+    ncard = pa_card_ext_changing_cards(u, type, cards);
+
+    sink   = (class == pa_policy_route_to_sink)   ? find_sink_by_type(u, type)   : NULL;
+    source = (class == pa_policy_route_to_source) ? find_source_by_type(u, type) : NULL;
 
     while ((group = group_scan(u->groups, &cursor)) != NULL) {
         if (group->flags & PA_POLICY_GROUP_FLAG_ROUTE_AUDIO) {
-            start_move_group(group);
-            ret++;
-            pa_assert(group->num_moving > 0 || group->sinpcnt + group->soutcnt == 0);
+            if (class == pa_policy_route_to_sink) {
+                nstream += start_move_sink_inputs(group, sink, cards, ncard);
+                nstream += start_move_source_outputs(group, group->source, cards, ncard);
+            }
+            else {
+                nstream += start_move_sink_inputs(group, group->sink, cards, ncard);
+                nstream += start_move_source_outputs(group, source, cards, ncard);
+            }
         }
     }
 
-    return ret;
+    pa_log_debug("routing %s to %s detached %d streams",
+                 class == pa_policy_route_to_sink ? "sink" : "source",
+                 type, nstream);
+
+    return nstream;
+}
+
+int pa_policy_group_count_routable(struct userdata *u)
+{
+    struct pa_policy_group *group = NULL;
+    struct cursor           cursor = { .idx = 0, .grp = NULL, };
+    int                     ngroup = 0;
+
+    pa_assert(u);
+
+    while ((group = group_scan(u->groups, &cursor)) != NULL) {
+        if (group->flags & PA_POLICY_GROUP_FLAG_ROUTE_AUDIO)
+            ngroup++;
+    }
+
+    return ngroup;
+}
+
+void pa_policy_group_moves_begin(struct userdata *u)
+{
+    pa_assert(u);
+    pa_assert(u->groups);
+
+    memset(&u->groups->moves, 0, sizeof(u->groups->moves));
+}
+
+void pa_policy_group_moves_report(struct userdata *u, uint32_t txid)
+{
+    struct pa_policy_move_stats *moves;
+
+    pa_assert(u);
+    pa_assert(u->groups);
+
+    moves = &u->groups->moves;
+
+    if (moves->sink_inputs || moves->source_outputs || moves->failed) {
+        pa_log_info("txid %u: moved %u sink inputs and %u source outputs "
+                    "in %llu usec (%u failed)", txid, moves->sink_inputs,
+                    moves->source_outputs, (unsigned long long) moves->usec,
+                    moves->failed);
+    }
 }
 
 int pa_policy_group_cork(struct userdata *u, const char *name, int corked)
@@ -1096,7 +1397,9 @@ static struct pa_policy_group *group_scan(struct pa_policy_groupset *gset,
 }
 
 
-static int move_group(struct pa_policy_group *group, struct target *target)
+static int move_group(struct userdata        *u,
+                      struct pa_policy_group *group,
+                      struct target          *target)
 {
     struct pa_sink               *sink;
     struct pa_source             *source;
@@ -1106,11 +1409,14 @@ static int move_group(struct pa_policy_group *group, struct target *target)
     struct pa_source_output      *sout;
     const char                   *sinkname;
     const char                   *sourcename;
+    pa_usec_t                     start;
     int                           ret = 0;
 
     if (!group || !target->any)
         return -1;
 
+    start = pa_rtclock_now();
+
     switch (target->class) {
     case pa_policy_route_to_sink:
         /* move sink inputs to the sink */
@@ -1125,34 +1431,11 @@ static int move_group(struct pa_policy_group *group, struct target *target)
         } else {
             pa_xfree(group->sinkname);
             group->sinkname = pa_xstrdup(sinkname);
-            group->sink = sink;
-            group->sinkidx = sink->index;
+            group_set_sink(u->groups, group, sink);
 
             if (!group->mutebyrt_sink) {
-                for (sil = group->sinpls; sil; sil = sil->next) {
-                    sinp = sil->sink_input;
-
-                    pa_log_debug("move sink input '%s' to sink '%s'",
-                                 pa_sink_input_ext_get_name(sinp),
-                                 sinkname);
-
-                    if (!sinp->sink) {
-                        pa_assert(group->num_moving > 0);
-                        if (pa_sink_input_finish_move(sinp, sink, true) >= 0)
-                            group->num_moving--;
-                        else {
-                            ret = -1;
-                            pa_log_error("Failed to finish moving %s to %s",
-                                         pa_sink_input_ext_get_name(sinp),
-                                         sinkname);
-                        }
-                    } else if (pa_sink_input_move_to(sinp, sink, true) < 0) {
-                        ret = -1;
-                        pa_log_error("Failed to move %s to %s",
-                                     pa_sink_input_ext_get_name(sinp),
-                                     sinkname);
-                    }
-                }
+                if (group_move_sink_inputs(u, group, sink) < 0)
+                    ret = -1;
             }
         }
 
@@ -1164,12 +1447,15 @@ static int move_group(struct pa_policy_group *group, struct target *target)
                              pa_sink_ext_get_name(group->sink));
                 if (pa_sink_input_finish_move(sinp, group->sink, true) < 0) {
                     ret = -1;
+                    group->stats.failed_moves++;
                     pa_log_error("Failed to re-attach %s to %s",
                                  pa_sink_input_ext_get_name(sinp),
                                  pa_sink_ext_get_name(group->sink));
                 }
-                else
+                else {
                     group->num_moving--;
+                    group->stats.moves++;
+                }
             }
         }
 
@@ -1187,33 +1473,11 @@ static int move_group(struct pa_policy_group *group, struct target *target)
                              group->name, pa_source_ext_get_name(source));
             }
         } else {
-            group->source = source;
+            group_set_source(u->groups, group, source);
 
             if (!group->mutebyrt_source) {
-                for (sol = group->soutls; sol; sol = sol->next) {
-                    sout = sol->source_output;
-
-                    pa_log_debug("move source output '%s' to source '%s'",
-                                 pa_source_output_ext_get_name(sout),
-                                 pa_source_ext_get_name(source));
-
-                    if (!sout->source) {
-                        pa_assert(group->num_moving > 0);
-                        if (pa_source_output_finish_move(sout, source, true) >= 0)
-                            group->num_moving--;
-                        else {
-                            ret = -1;
-                            pa_log_error("Failed to finish moving %s to %s",
-                                         pa_source_output_ext_get_name(sout),
-                                         pa_source_ext_get_name(source));
-                        }
-                    } else if (pa_source_output_move_to(sout, source, true) < 0) {
-                        ret = -1;
-                        pa_log_error("Failed to move %s to %s",
-                                     pa_source_output_ext_get_name(sout),
-                                     pa_source_ext_get_name(source));
-                    }
-                }
+                if (group_move_source_outputs(u, group, source) < 0)
+                    ret = -1;
             }
         }
 
@@ -1225,11 +1489,14 @@ static int move_group(struct pa_policy_group *group, struct target *target)
                              pa_source_ext_get_name(group->source));
                 if (pa_source_output_finish_move(sout, group->source, true) < 0) {
                     ret = -1;
+                    group->stats.failed_moves++;
                     pa_log_error("Failed to re-attach %s to %s",
                                  pa_source_output_ext_get_name(sout),
                                  pa_source_ext_get_name(group->source));
-                } else
+                } else {
                     group->num_moving--;
+                    group->stats.moves++;
+                }
             }
         }
 
@@ -1241,10 +1508,181 @@ static int move_group(struct pa_policy_group *group, struct target *target)
         break;
     } /* switch class */
 
+    group->stats.move_usec += pa_rtclock_now() - start;
+
     return ret;
 }
 
 
+/*
+ * The streams of a group are moved in two passes, first detaching all of
+ * them from their current sink (source) and then attaching them to the
+ * target, so that none of them starts on the target while others of the
+ * group still play on the old sink. PulseAudio has no bulk move, so every
+ * stream still does its own start_move/finish_move round trips; this is
+ * not cheaper than pa_*_move_to(). Streams detached earlier, e.g. by
+ * pa_policy_group_start_move(), are attached in the second pass.
+ */
+static int group_move_sink_inputs(struct userdata        *u,
+                                  struct pa_policy_group *group,
+                                  struct pa_sink         *sink)
+{
+    struct pa_policy_move_stats *moves;
+    struct pa_sink_input_list   *sil;
+    struct pa_sink_input_list   *next;
+    struct pa_sink_input        *sinp;
+    const char                  *sinkname;
+    pa_usec_t                    start;
+    int                          ret = 0;
+
+    pa_assert(u);
+    pa_assert(u->groups);
+    pa_assert(group);
+    pa_assert(sink);
+
+    moves    = &u->groups->moves;
+    sinkname = pa_sink_ext_get_name(sink);
+    start    = pa_rtclock_now();
+
+    for (sil = group->sinpls; sil; sil = sil->next) {
+        sinp = sil->sink_input;
+
+        if (!sinp->sink || sinp->sink == sink)
+            continue;
+
+        pa_log_debug("move sink input '%s' to sink '%s'",
+                     pa_sink_input_ext_get_name(sinp), sinkname);
+
+        if (!pa_sink_input_may_move_to(sinp, sink) ||
+            pa_sink_input_start_move(sinp) < 0)
+        {
+            ret = -1;
+            moves->failed++;
+            group->stats.failed_moves++;
+            pa_log_error("Failed to move %s to %s",
+                         pa_sink_input_ext_get_name(sinp), sinkname);
+        }
+        else
+            group->num_moving++;
+    }
+
+    for (sil = group->sinpls; sil; sil = next) {
+        next = sil->next;
+        sinp = sil->sink_input;
+
+        if (sinp->sink)
+            continue;
+
+        pa_assert(group->num_moving > 0);
+
+        if (pa_sink_input_finish_move(sinp, sink, true) >= 0) {
+            group->num_moving--;
+            moves->sink_inputs++;
+            group->stats.moves++;
+        }
+        else {
+            ret = -1;
+            moves->failed++;
+            group->stats.failed_moves++;
+            pa_log_error("Failed to finish moving %s to %s",
+                         pa_sink_input_ext_get_name(sinp), sinkname);
+
+            /* the stream is either rescued to another sink or killed;
+               a killed one is taken off the group when it is unlinked */
+            pa_sink_input_ref(sinp);
+            pa_sink_input_fail_move(sinp);
+
+            if (PA_SINK_INPUT_IS_LINKED(sinp->state))
+                group->num_moving--;
+
+            pa_sink_input_unref(sinp);
+        }
+    }
+
+    moves->usec += pa_rtclock_now() - start;
+
+    return ret;
+}
+
+static int group_move_source_outputs(struct userdata        *u,
+                                     struct pa_policy_group *group,
+                                     struct pa_source       *source)
+{
+    struct pa_policy_move_stats  *moves;
+    struct pa_source_output_list *sol;
+    struct pa_source_output_list *next;
+    struct pa_source_output      *sout;
+    const char                   *sourcename;
+    pa_usec_t                     start;
+    int                           ret = 0;
+
+    pa_assert(u);
+    pa_assert(u->groups);
+    pa_assert(group);
+    pa_assert(source);
+
+    moves      = &u->groups->moves;
+    sourcename = pa_source_ext_get_name(source);
+    start      = pa_rtclock_now();
+
+    for (sol = group->soutls; sol; sol = sol->next) {
+        sout = sol->source_output;
+
+        if (!sout->source || sout->source == source)
+            continue;
+
+        pa_log_debug("move source output '%s' to source '%s'",
+                     pa_source_output_ext_get_name(sout), sourcename);
+
+        if (!pa_source_output_may_move_to(sout, source) ||
+            pa_source_output_start_move(sout) < 0)
+        {
+            ret = -1;
+            moves->failed++;
+            group->stats.failed_moves++;
+            pa_log_error("Failed to move %s to %s",
+                         pa_source_output_ext_get_name(sout), sourcename);
+        }
+        else
+            group->num_moving++;
+    }
+
+    for (sol = group->soutls; sol; sol = next) {
+        next = sol->next;
+        sout = sol->source_output;
+
+        if (sout->source)
+            continue;
+
+        pa_assert(group->num_moving > 0);
+
+        if (pa_source_output_finish_move(sout, source, true) >= 0) {
+            group->num_moving--;
+            moves->source_outputs++;
+            group->stats.moves++;
+        }
+        else {
+            ret = -1;
+            moves->failed++;
+            group->stats.failed_moves++;
+            pa_log_error("Failed to finish moving %s to %s",
+                         pa_source_output_ext_get_name(sout), sourcename);
+
+            pa_source_output_ref(sout);
+            pa_source_output_fail_move(sout);
+
+            if (PA_SOURCE_OUTPUT_IS_LINKED(sout->state))
+                group->num_moving--;
+
+            pa_source_output_unref(sout);
+        }
+    }
+
+    moves->usec += pa_rtclock_now() - start;
+
+    return ret;
+}
+
 static int volset_group(struct userdata        *u,
                         struct pa_policy_group *group,
                         pa_volume_t             percent)
@@ -1252,8 +1690,6 @@ static int volset_group(struct userdata        *u,
     pa_volume_t limit;
     struct pa_sink_input_list *sl;
     struct pa_sink_input *sinp;
-    struct pa_sink *sink;
-    struct pa_sink_ext *ext;
     int vset;
     int retval;
 
@@ -1266,6 +1702,7 @@ static int volset_group(struct userdata        *u,
     }
     else {
         group->limit = limit;
+        group->stats.limit_changes++;
 
         if (!group->locmute) {
             for (sl = group->sinpls;   sl != NULL;   sl = sl->next) {
@@ -1275,15 +1712,8 @@ static int volset_group(struct userdata        *u,
                 if (vset < 0)
                     retval = -1;
                 else {
-                    sink = sinp->sink;
-                    ext  = pa_sink_ext_lookup(u, sink);
-
-                    pa_assert(ext);
-
                     pa_log_debug("set volume limit %d for sink input '%s'",
                                  percent, pa_sink_input_ext_get_name(sinp));
-
-                    ext->need_volume_setting |= vset;
                 }
             }
         }
@@ -1344,14 +1774,11 @@ static int mute_group_by_route(struct userdata        *u,
                                struct pa_policy_group *group,
                                int                     mute)
 {
-    struct pa_sink_input_list *sl;
-    struct pa_sink_input *sinp;
     struct pa_sink *sink;
     const char *sink_name;
-    struct pa_source_output_list *soutls;
-    struct pa_source_output *sout;
     struct pa_source *source;
     const char *source_name;
+    bool changed = false;
     int ret = 0;
 
     sink = mute ? u->nullsink->sink : group->sink;
@@ -1380,18 +1807,11 @@ static int mute_group_by_route(struct userdata        *u,
                          mute ? "on" : "off");
 
             group->mutebyrt_sink = mute;
+            changed = true;
 
             if (!group->locmute) {
-                for (sl = group->sinpls;   sl != NULL;   sl = sl->next) {
-                    sinp = sl->sink_input;
-
-                    pa_log_debug("move sink input '%s' to sink '%s' by "
-                                 "mute-by-route",
-                                 pa_sink_input_ext_get_name(sinp), sink_name);
-
-                    if (pa_sink_input_move_to(sinp, sink, true) < 0)
-                        ret = -1;
-                }
+                if (group_move_sink_inputs(u, group, sink) < 0)
+                    ret = -1;
             }
         }
     }
@@ -1410,22 +1830,22 @@ static int mute_group_by_route(struct userdata        *u,
                          mute ? "on" : "off");
 
             group->mutebyrt_source = mute;
+            changed = true;
 
             if (!group->locmute) {
-                for (soutls = group->soutls;   soutls != NULL;   soutls = soutls->next) {
-                    sout = soutls->source_output;
-
-                    pa_log_debug("move source output '%s' to source '%s' by "
-                                 "mute-by-route",
-                                 pa_source_output_ext_get_name(sout), source_name);
-
-                    if (pa_source_output_move_to(sout, source, true) < 0)
-                        ret = -1;
-                }
+                if (group_move_source_outputs(u, group, source) < 0)
+                    ret = -1;
             }
         }
     }
 
+    if (changed) {
+        if (mute)
+            group->stats.mutes_by_route++;
+        else
+            group->stats.unmutes_by_route++;
+    }
+
     return ret;
 }
 
@@ -1483,16 +1903,23 @@ static int mute_group_locally(struct userdata        *u,
                              group->name, sinp_name, sink_name);
 
                 if (sinp->sink) {
-                    if (pa_sink_input_move_to(sinp, sink, true) < 0)
+                    if (pa_sink_input_move_to(sinp, sink, true) < 0) {
                         ret = -1;
+                        group->stats.failed_moves++;
+                    }
+                    else
+                        group->stats.moves++;
                 } else {
                     pa_log_debug("stream '%s'/'%s' is currently moving. finishing move",
                             group->name, sinp_name);
-                    if (pa_sink_input_finish_move(sinp, sink, true) < 0)
+                    if (pa_sink_input_finish_move(sinp, sink, true) < 0) {
                         ret = -1;
+                        group->stats.failed_moves++;
+                    }
                     else {
                         pa_assert(group->num_moving > 0);
                         group->num_moving--;
+                        group->stats.moves++;
                     }
                 }
 
@@ -1534,6 +1961,11 @@ static int cork_group(struct userdata *u, struct pa_policy_group *group, int cor
     else {
         group->corked = corked;
 
+        if (corked)
+            group->stats.corks++;
+        else
+            group->stats.uncorks++;
+
         for (sl = group->sinpls;    sl;   sl = sl->next) {
             sinp = sl->sink_input;
 
@@ -1554,13 +1986,20 @@ static struct pa_policy_group *find_group_by_name(struct pa_policy_groupset *gse
                                                   const char *name, uint32_t *ridx)
 {
     struct pa_policy_group *group = NULL;
-    uint32_t                idx   = hash_value(name);
+    const char             *atom;
+    uint32_t                idx;
     
     pa_assert(gset);
     pa_assert(name);
 
+    /* a name that was never interned can't be a group name */
+    if ((atom = pa_policy_atom_find(gset->atoms, name)) == NULL)
+        return NULL;
+
+    idx = hash_value(atom);
+
     for (group = gset->hash_tbl[idx];   group != NULL;  group = group->next) {
-        if (!strcmp(name, group->name))
+        if (atom == group->name)
             break;
     }    
 
@@ -1571,6 +2010,16 @@ static struct pa_policy_group *find_group_by_name(struct pa_policy_groupset *gse
 }
 
 
+static bool group_sink_is_running(struct userdata *u, struct pa_policy_group *group)
+{
+    pa_sink *sink;
+
+    if ((sink = pa_policy_group_find_sink(u, group)))
+        return sink->state == PA_SINK_RUNNING;
+
+    return false;
+}
+
 static struct pa_sink *find_sink_by_type(struct userdata *u, const char *type)
 {
     void            *state = NULL;
@@ -1609,18 +2058,161 @@ static struct pa_source *find_source_by_type(struct userdata *u, const char *typ
     return source;
 }
 
-static uint32_t hash_value(const char *s)
+static uint32_t hash_value(const char *atom)
 {
-    uint32_t hash = 0;
-    unsigned char c;
+    uint32_t hash;
 
-    if (s) {
-        while ((c = *s++) != '\0') {
-            hash = 38501 * (hash + c);
-        }
+    /* atoms are unique, so their address is as good as their contents */
+    hash = (uint32_t) ((uintptr_t) atom >> 3) * 2654435761U;
+
+    return (hash >> (32 - PA_POLICY_GROUP_HASH_BITS)) & PA_POLICY_GROUP_HASH_MASK;
+}
+
+static void group_set_sink(struct pa_policy_groupset *gset,
+                           struct pa_policy_group    *group,
+                           struct pa_sink            *sink)
+{
+    uint32_t idx = sink ? sink->index : PA_IDXSET_INVALID;
+
+    if (group->sink == sink && group->sinkidx == idx)
+        return;
+
+    if (group->sinkidx != PA_IDXSET_INVALID) {
+        if (group->sink_prev != NULL)
+            group->sink_prev->sink_next = group->sink_next;
+        else if (group->sink_next != NULL)
+            pa_index_hash_add(gset->sinkgrps, group->sinkidx, group->sink_next);
+        else
+            pa_index_hash_remove(gset->sinkgrps, group->sinkidx);
+
+        if (group->sink_next != NULL)
+            group->sink_next->sink_prev = group->sink_prev;
+    }
+
+    group->sink      = sink;
+    group->sinkidx   = idx;
+    group->sink_next = group->sink_prev = NULL;
+
+    if (idx != PA_IDXSET_INVALID) {
+        if ((group->sink_next = pa_index_hash_lookup(gset->sinkgrps, idx)))
+            group->sink_next->sink_prev = group;
+
+        pa_index_hash_add(gset->sinkgrps, idx, group);
+    }
+}
+
+static void group_set_source(struct pa_policy_groupset *gset,
+                             struct pa_policy_group    *group,
+                             struct pa_source          *source)
+{
+    uint32_t idx = source ? source->index : PA_IDXSET_INVALID;
+
+    if (group->source == source && group->srcidx == idx)
+        return;
+
+    if (group->srcidx != PA_IDXSET_INVALID) {
+        if (group->src_prev != NULL)
+            group->src_prev->src_next = group->src_next;
+        else if (group->src_next != NULL)
+            pa_index_hash_add(gset->srcgrps, group->srcidx, group->src_next);
+        else
+            pa_index_hash_remove(gset->srcgrps, group->srcidx);
+
+        if (group->src_next != NULL)
+            group->src_next->src_prev = group->src_prev;
     }
 
-    return hash & PA_POLICY_GROUP_HASH_MASK;
+    group->source   = source;
+    group->srcidx   = idx;
+    group->src_next = group->src_prev = NULL;
+
+    if (idx != PA_IDXSET_INVALID) {
+        if ((group->src_next = pa_index_hash_lookup(gset->srcgrps, idx)))
+            group->src_next->src_prev = group;
+
+        pa_index_hash_add(gset->srcgrps, idx, group);
+    }
+}
+
+static struct pa_policy_group *groups_of_sink(struct pa_policy_groupset *gset,
+                                              uint32_t idx)
+{
+    if (idx == PA_IDXSET_INVALID)
+        return NULL;
+
+    return pa_index_hash_lookup(gset->sinkgrps, idx);
+}
+
+static struct pa_policy_group *groups_of_source(struct pa_policy_groupset *gset,
+                                                uint32_t idx)
+{
+    if (idx == PA_IDXSET_INVALID)
+        return NULL;
+
+    return pa_index_hash_lookup(gset->srcgrps, idx);
+}
+
+static uint64_t counter_value(struct pa_policy_group *group,
+                              const struct counter   *c)
+{
+    const char *base = (const char *) &group->stats;
+
+    if (c->usec)
+        return *(const pa_usec_t *) (base + c->offs);
+    else
+        return *(const uint32_t *) (base + c->offs);
+}
+
+static void sink_input_list_link(struct pa_policy_group    *group,
+                                 struct pa_sink_input_list *sl)
+{
+    sl->group = group;
+    sl->prev  = NULL;
+
+    if ((sl->next = group->sinpls) != NULL)
+        sl->next->prev = sl;
+
+    group->sinpls = sl;
+}
+
+static void sink_input_list_unlink(struct pa_sink_input_list *sl)
+{
+    if (sl->prev != NULL)
+        sl->prev->next = sl->next;
+    else
+        sl->group->sinpls = sl->next;
+
+    if (sl->next != NULL)
+        sl->next->prev = sl->prev;
+
+    sl->next = sl->prev = NULL;
+    sl->group = NULL;
+}
+
+static void source_output_list_link(struct pa_policy_group       *group,
+                                    struct pa_source_output_list *sl)
+{
+    sl->group = group;
+    sl->prev  = NULL;
+
+    if ((sl->next = group->soutls) != NULL)
+        sl->next->prev = sl;
+
+    group->soutls = sl;
+}
+
+static void source_output_list_unlink(struct pa_source_output_list *sl)
+{
+    if (sl->prev != NULL)
+        sl->prev->next = sl->next;
+    else
+        sl->group->soutls = sl->next;
+
+    if (sl->next != NULL)
+        sl->next->prev = sl->prev;
+
+    sl->next = sl->prev = NULL;
+    sl->group = NULL;
 }
 
 /*
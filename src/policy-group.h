@@ -28,22 +28,47 @@
 
 #define PA_POLICY_GROUP_FLAGS_NOPOLICY     PA_POLICY_GROUP_FLAG_NONE
 
+struct pa_policy_group;
+struct pa_sink_input_ext;
+struct pa_index_hash;
+
 struct pa_sink_input_list {
     struct pa_sink_input_list    *next;
+    struct pa_sink_input_list    *prev;
+    struct pa_policy_group       *group;    /* group the stream belongs to */
     uint32_t                      index;
     struct pa_sink_input         *sink_input;
+    struct pa_sink_input_ext     *ext;      /* points back to this entry */
 };
 
 struct pa_source_output_list {
     struct pa_source_output_list *next;
+    struct pa_source_output_list *prev;
+    struct pa_policy_group       *group;    /* group the stream belongs to */
     uint32_t                      index;
     struct pa_source_output      *source_output;
 };
 
+/* Runtime counters of a group since the module was loaded */
+struct pa_policy_group_stats {
+    uint32_t                      sinp_added;      /* sink inputs inserted */
+    uint32_t                      sinp_removed;    /* sink inputs removed */
+    uint32_t                      sout_added;      /* source outputs inserted */
+    uint32_t                      sout_removed;    /* source outputs removed */
+    uint32_t                      moves;           /* streams moved */
+    uint32_t                      failed_moves;    /* stream moves failed */
+    uint32_t                      corks;           /* group corked */
+    uint32_t                      uncorks;         /* group uncorked */
+    uint32_t                      mutes_by_route;  /* mute-by-route on */
+    uint32_t                      unmutes_by_route;/* mute-by-route off */
+    uint32_t                      limit_changes;   /* volume limit changed */
+    pa_usec_t                     move_usec;       /* time spent in move_group */
+};
+
 struct pa_policy_group {
     struct pa_policy_group       *next;     /* hash link*/
     uint32_t                      flags;    /* or'ed PA_POLICY_GROUP_FLAG_x's*/
-    char                         *name;     /* name of the policy group */
+    const char                   *name;     /* name of the policy group (atom) */
     char                         *sinkname; /* name of the default sink */
     char                         *portname; /* name of the default port */
     struct pa_sink               *sink;     /* default sink for the group */
@@ -63,12 +88,32 @@ struct pa_policy_group {
     int                           sinpcnt;  /* sink input counter */
     int                           soutcnt;  /* source output counter */
     int                           num_moving;   /* Number of moving streams */
+    bool                          sink_active;  /* group sink is running, or
+                                                   the group has no dynamic sink */
+    struct pa_policy_group       *sink_next;    /* groups of the same sink */
+    struct pa_policy_group       *sink_prev;
+    struct pa_policy_group       *src_next;     /* groups of the same source */
+    struct pa_policy_group       *src_prev;
     pa_proplist                  *properties;   /* properties to set for each sink input*/
+    struct pa_policy_group_stats  stats;
+    char                         *stats_exported; /* last published stats */
+};
+
+struct pa_policy_move_stats {
+    uint32_t                   sink_inputs;     /* moved sink inputs */
+    uint32_t                   source_outputs;  /* moved source outputs */
+    uint32_t                   failed;          /* failed moves */
+    pa_usec_t                  usec;            /* time spent moving */
 };
 
 struct pa_policy_groupset {
     struct pa_policy_group    *dflt;     /*  default group */
     struct pa_policy_group    *hash_tbl[PA_POLICY_GROUP_HASH_DIM];
+    struct pa_policy_atoms    *atoms;    /* group names are hashed by atom */
+    struct pa_index_hash      *soutidx;  /* source output idx -> list entry */
+    struct pa_index_hash      *sinkgrps; /* sink idx -> groups of the sink */
+    struct pa_index_hash      *srcgrps;  /* source idx -> groups of the source */
+    struct pa_policy_move_stats moves;   /* of the current transaction */
 };
 
 enum pa_policy_route_class {
@@ -90,6 +135,7 @@ void pa_policy_groupset_unregister_source(struct userdata *, uint32_t);
 void pa_policy_groupset_update_sources(struct userdata *u);
 void pa_policy_groupset_create_default_group(struct userdata *, const char *);
 int pa_policy_groupset_restore_volume(struct userdata *, struct pa_sink *);
+void pa_policy_groupset_update_sink_active(struct userdata *, struct pa_sink *);
 
 struct pa_policy_group *pa_policy_group_new(struct userdata *, const char*,
                                             const char *sink,
@@ -118,11 +164,29 @@ void pa_policy_group_remove_source_output(struct userdata *, uint32_t);
 int  pa_policy_group_move_to(struct userdata *, const char *,
                              enum pa_policy_route_class, const char *,
                              const char *, const char *);
-int  pa_policy_group_start_move_all(struct userdata *u);
+/* Detach the streams the given routing decision moves. Returns the number
+ * of detached streams. */
+int  pa_policy_group_start_move(struct userdata *u, enum pa_policy_route_class,
+                                const char *);
+/* Number of groups that follow the audio route */
+int  pa_policy_group_count_routable(struct userdata *u);
 void pa_policy_group_assert_moving(struct userdata *u);
+void pa_policy_group_moves_begin(struct userdata *u);
+void pa_policy_group_moves_report(struct userdata *u, uint32_t txid);
 int  pa_policy_group_cork(struct userdata *u, const char *, int);
 int  pa_policy_group_volume_limit(struct userdata *, const char *, uint32_t);
 
+/* Iterate over all groups; start with NULL. */
+struct pa_policy_group *pa_policy_group_next(struct userdata *,
+                                             struct pa_policy_group *);
+/* Calls the callback with the name and value of every counter of the group */
+void pa_policy_group_stats_foreach(struct pa_policy_group *,
+                                   void (*)(const char *, uint64_t, void *),
+                                   void *);
+/* Publish the counters of the groups whose counters changed since the
+ * last call in the module property list */
+void pa_policy_groupset_export_stats(struct userdata *);
+
 pa_sink *pa_policy_group_find_sink(struct userdata *u, struct pa_policy_group *group);
 bool pa_policy_group_sink(struct pa_policy_group *group, pa_sink *sink);
 bool pa_policy_group_source(struct pa_policy_group *group, pa_source *source);
@@ -17,7 +17,7 @@
 void pa_policy_send_device_state(struct userdata *u, bool is_connected,
                                  const struct pa_classify_result *list)
 {
-    pa_policy_dbusif_send_device_state(u, is_connected, list);
+    pa_policy_dbusif_queue_device_state(u, is_connected, list);
 }
 
 void pa_policy_send_card_state(struct userdata *u, const struct pa_classify_result *list,
@@ -37,23 +37,14 @@ void pa_policy_send_device_state_full(struct userdata *u)
     struct pa_card   *card;
     struct pa_sink   *sink;
     struct pa_source *source;
-    struct pa_classify_result *r;
+    struct pa_classify_result  all;
+    struct pa_classify_result  connected;
+    struct pa_classify_result  r;
 
     pa_assert(u);
     pa_assert(u->core);
 
-    /* first reset all types to off */
-    pa_classify_card_all_types(u, &r);
-    pa_policy_dbusif_send_device_state(u, PA_POLICY_DISCONNECTED, r);
-    pa_xfree(r);
-
-    pa_classify_sink_all_types(u, &r);
-    pa_policy_dbusif_send_device_state(u, PA_POLICY_DISCONNECTED, r);
-    pa_xfree(r);
-
-    pa_classify_source_all_types(u, &r);
-    pa_policy_dbusif_send_device_state(u, PA_POLICY_DISCONNECTED, r);
-    pa_xfree(r);
+    pa_classify_result_clear(&connected);
 
     /* cards */
     pa_assert_se((idxset = u->core->cards));
@@ -62,8 +53,7 @@ void pa_policy_send_device_state_full(struct userdata *u)
     while ((card = pa_idxset_iterate(idxset, &state, NULL))) {
         pa_classify_card(u, card, PA_POLICY_DISABLE_NOTIFY, 0,
                          true, &r);
-        pa_policy_dbusif_send_device_state(u, PA_POLICY_CONNECTED, r);
-        pa_xfree(r);
+        pa_classify_result_union(&connected, &r);
     }
 
     /* sinks */
@@ -72,8 +62,7 @@ void pa_policy_send_device_state_full(struct userdata *u)
 
     while ((sink = pa_idxset_iterate(idxset, &state, NULL))) {
         pa_classify_sink(u, sink, PA_POLICY_DISABLE_NOTIFY, 0, &r);
-        pa_policy_dbusif_send_device_state(u, PA_POLICY_CONNECTED, r);
-        pa_xfree(r);
+        pa_classify_result_union(&connected, &r);
     }
 
     /* sources */
@@ -82,9 +71,20 @@ void pa_policy_send_device_state_full(struct userdata *u)
 
     while ((source = pa_idxset_iterate(idxset, &state, NULL))) {
         pa_classify_source(u, source, PA_POLICY_DISABLE_NOTIFY, 0, &r);
-        pa_policy_dbusif_send_device_state(u, PA_POLICY_CONNECTED, r);
-        pa_xfree(r);
+        pa_classify_result_union(&connected, &r);
     }
+
+    /* every known type that is not connected is reported as disconnected */
+    pa_classify_card_all_types(u, &all);
+    pa_classify_sink_all_types(u, &r);
+    pa_classify_result_union(&all, &r);
+    pa_classify_source_all_types(u, &r);
+    pa_classify_result_union(&all, &r);
+
+    pa_classify_result_diff(&all, &connected);
+
+    /* the full state supersedes any queued changes */
+    pa_policy_dbusif_send_device_state(u, &all, &connected);
 }
 
 void pa_policy_send_port_available_changed(struct userdata *u,
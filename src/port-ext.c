@@ -81,13 +81,13 @@ static pa_hook_result_t available_changed(void *hook_data, void *call_data,
 
 static void handle_available_changed(struct userdata *u, pa_device_port *p)
 {
-    struct pa_classify_result *result = NULL;
-    pa_classify_port_get_device_types(u, p->direction, p->name, PA_POLICY_UPDATE_AVAILABLE, &result);
+    struct pa_classify_result result;
+    int id;
 
-    for (int i = 0; i < result->count; i++)
-        pa_policy_send_port_available_changed(u, result->types[i], p->available == PA_AVAILABLE_YES);
+    pa_classify_port_get_device_types(u, p->direction, p->name, PA_POLICY_UPDATE_AVAILABLE, &result);
 
-    pa_xfree(result);
+    PA_CLASSIFY_RESULT_FOREACH(id, &result)
+        pa_policy_send_port_available_changed(u, pa_classify_type_name(u, id), p->available == PA_AVAILABLE_YES);
 }
 
 /*
@@ -43,6 +43,7 @@ struct pa_sink_ext_data {
 /* hooks */
 static pa_hook_result_t sink_put(void *, void *, void *);
 static pa_hook_result_t sink_unlink(void *, void *, void *);
+static pa_hook_result_t sink_state_changed(void *, void *, void *);
 
 static void handle_new_sink(struct userdata *, struct pa_sink *);
 static void handle_removed_sink(struct userdata *, struct pa_sink *);
@@ -100,6 +101,7 @@ struct pa_sink_evsubscr *pa_sink_ext_subscription(struct userdata *u)
     struct pa_sink_evsubscr *subscr;
     pa_hook_slot            *put;
     pa_hook_slot            *unlink;
+    pa_hook_slot            *state;
     
     pa_assert(u);
     pa_assert_se((core = u->core));
@@ -110,12 +112,15 @@ struct pa_sink_evsubscr *pa_sink_ext_subscription(struct userdata *u)
                              PA_HOOK_LATE, sink_put, (void *)u);
     unlink = pa_hook_connect(hooks + PA_CORE_HOOK_SINK_UNLINK_POST,
                              PA_HOOK_LATE, sink_unlink, (void *)u);
+    state  = pa_hook_connect(hooks + PA_CORE_HOOK_SINK_STATE_CHANGED,
+                             PA_HOOK_EARLY, sink_state_changed, (void *)u);
     
 
     subscr = pa_xnew0(struct pa_sink_evsubscr, 1);
     
     subscr->put    = put;
     subscr->unlink = unlink;
+    subscr->state  = state;
 
     return subscr;
 }
@@ -125,6 +130,7 @@ void  pa_sink_ext_subscription_free(struct pa_sink_evsubscr *subscr)
     if (subscr != NULL) {
         pa_hook_slot_free(subscr->put);
         pa_hook_slot_free(subscr->unlink);
+        pa_hook_slot_free(subscr->state);
 
         pa_xfree(subscr);
     }
@@ -490,6 +496,21 @@ static pa_hook_result_t sink_unlink(void *hook_data, void *call_data,
 }
 
 
+static pa_hook_result_t sink_state_changed(void *hook_data, void *call_data,
+                                           void *slot_data)
+{
+    struct pa_sink  *sink = (struct pa_sink *)call_data;
+    struct userdata *u    = (struct userdata *)slot_data;
+
+    if (sink && u) {
+        pa_policy_groupset_update_sink_active(u, sink);
+        pa_policy_activity_sink_state_changed(u, sink);
+    }
+
+    return PA_HOOK_OK;
+}
+
+
 static void handle_new_sink(struct userdata *u, struct pa_sink *sink)
 {
     const char *name;
@@ -498,7 +519,7 @@ static void handle_new_sink(struct userdata *u, struct pa_sink *sink)
     int       ret;
     struct pa_null_sink *ns;
     struct pa_sink_ext  *ext;
-    struct pa_classify_result *r;
+    struct pa_classify_result  r;
 
     if (sink && u) {
         name = pa_sink_ext_get_name(sink);
@@ -516,7 +537,7 @@ static void handle_new_sink(struct userdata *u, struct pa_sink *sink)
 
         if (pa_policy_log_level_debug()) {
             pa_classify_sink(u, sink, 0, 0, &r);
-            buf = pa_policy_log_concat(r->types, r->count);
+            buf = pa_classify_result_to_string(u, &r);
             ret = pa_proplist_sets(sink->proplist,
                                    PA_PROP_POLICY_DEVTYPELIST, buf);
 
@@ -525,9 +546,8 @@ static void handle_new_sink(struct userdata *u, struct pa_sink *sink)
                        PA_PROP_POLICY_DEVTYPELIST, name);
 
             pa_log_debug("new sink '%s' (idx=%d%s%s)",
-                         name, idx, r->count > 0 ? ", type=" : "", buf);
+                         name, idx, pa_classify_result_count(&r) > 0 ? ", type=" : "", buf);
             pa_xfree(buf);
-            pa_xfree(r);
         }
 
         ext = pa_xmalloc0(sizeof(struct pa_sink_ext));
@@ -535,10 +555,10 @@ static void handle_new_sink(struct userdata *u, struct pa_sink *sink)
 
         pa_policy_groupset_update_default_sink(u, PA_IDXSET_INVALID);
         pa_policy_groupset_register_sink(u, sink);
+        pa_policy_groupset_update_sink_active(u, sink);
 
         pa_classify_sink(u, sink, PA_POLICY_DISABLE_NOTIFY, 0, &r);
-        pa_policy_send_device_state(u, PA_POLICY_CONNECTED, r);
-        pa_xfree(r);
+        pa_policy_send_device_state(u, PA_POLICY_CONNECTED, &r);
     }
 }
 
@@ -549,7 +569,7 @@ static void handle_removed_sink(struct userdata *u, struct pa_sink *sink)
     char                *buf;
     struct pa_null_sink *ns;
     struct pa_sink_ext  *ext;
-    struct pa_classify_result *r;
+    struct pa_classify_result  r;
 
     if (sink && u) {
         name = pa_sink_ext_get_name(sink);
@@ -571,15 +591,15 @@ static void handle_removed_sink(struct userdata *u, struct pa_sink *sink)
 
         if (pa_policy_log_level_debug()) {
             pa_classify_sink(u, sink, 0, 0, &r);
-            buf = pa_policy_log_concat(r->types, r->count);
+            buf = pa_classify_result_to_string(u, &r);
             pa_log_debug("remove sink '%s' (idx=%d%s%s)",
-                         name, idx, r->count > 0 ? ", type=" : "", buf);
+                         name, idx, pa_classify_result_count(&r) > 0 ? ", type=" : "", buf);
             pa_xfree(buf);
-            pa_xfree(r);
         }
 
         pa_policy_groupset_update_default_sink(u, idx);
         pa_policy_groupset_unregister_sink(u, idx);
+        pa_policy_groupset_update_sink_active(u, sink);
 
         if ((ext = pa_index_hash_remove(u->hsnk, idx)) == NULL)
             pa_log("no extension found for sink '%s' (idx=%u)",name, idx);
@@ -589,8 +609,7 @@ static void handle_removed_sink(struct userdata *u, struct pa_sink *sink)
         }
 
         pa_classify_sink(u, sink, PA_POLICY_DISABLE_NOTIFY, 0, &r);
-        pa_policy_send_device_state(u, PA_POLICY_DISCONNECTED, r);
-        pa_xfree(r);
+        pa_policy_send_device_state(u, PA_POLICY_DISCONNECTED, &r);
 
         pa_policy_groupset_update_sinks(u);
     }
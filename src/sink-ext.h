@@ -13,6 +13,7 @@ struct pa_null_sink {
 struct pa_sink_evsubscr {
     pa_hook_slot    *put;
     pa_hook_slot    *unlink;
+    pa_hook_slot    *state;
 };
 
 struct pa_sink_ext {
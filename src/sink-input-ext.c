@@ -13,6 +13,7 @@
 #include <pulsecore/sink.h>
 #include <pulsecore/sink-input.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
 
 #include "userdata.h"
 #include "index-hash.h"
@@ -21,6 +22,7 @@
 #include "sink-ext.h"
 #include "classify.h"
 #include "context.h"
+#include "client-ext.h"
 
 #define VOLUME_LIMIT_FACTOR_KEY "x-policy.volume.factor"
 
@@ -42,6 +44,7 @@ static void handle_sink_input_fixate(struct userdata *u, pa_sink_input_new_data
 static void handle_removed_sink_input(struct userdata *,
                                       struct pa_sink_input *);
 static uint32_t update_state_flag(uint32_t flags, enum pa_sink_input_ext_state flag, bool set);
+static void rediscover_cb(pa_mainloop_api *, pa_defer_event *, void *);
 
 struct pa_sinp_evsubscr *pa_sink_input_ext_subscription(struct userdata *u)
 {
@@ -81,6 +84,14 @@ struct pa_sinp_evsubscr *pa_sink_input_ext_subscription(struct userdata *u)
     subscr->cork_state = NULL;
     subscr->mute_state = NULL;
 
+    subscr->mainloop   = core->mainloop;
+    subscr->rediscover = core->mainloop->defer_new(core->mainloop, rediscover_cb, u);
+    subscr->app_ids    = pa_hashmap_new_full(pa_idxset_string_hash_func,
+                                             pa_idxset_string_compare_func,
+                                             pa_xfree, NULL);
+
+    core->mainloop->defer_enable(subscr->rediscover, 0);
+
     return subscr;
 }
 
@@ -95,6 +106,10 @@ void  pa_sink_input_ext_subscription_free(struct pa_sinp_evsubscr *subscr)
             pa_hook_slot_free(subscr->cork_state);
         if (subscr->mute_state)
             pa_hook_slot_free(subscr->mute_state);
+        if (subscr->rediscover)
+            subscr->mainloop->defer_free(subscr->rediscover);
+        if (subscr->app_ids)
+            pa_hashmap_free(subscr->app_ids);
 
         pa_xfree(subscr);
     }
@@ -114,8 +129,29 @@ void pa_sink_input_ext_discover(struct userdata *u)
         handle_new_sink_input(u, sinp, NULL, NULL);
 }
 
-void  pa_sink_input_ext_rediscover(struct userdata *u)
+void  pa_sink_input_ext_rediscover(struct userdata *u, const char *app_id)
 {
+    struct pa_sinp_evsubscr *subscr;
+    char                    *key;
+
+    pa_assert(u);
+    pa_assert_se((subscr = u->ssi));
+
+    if (!app_id)
+        return;
+
+    if (!pa_hashmap_get(subscr->app_ids, app_id)) {
+        key = pa_xstrdup(app_id);
+        pa_hashmap_put(subscr->app_ids, key, key);
+    }
+
+    subscr->mainloop->defer_enable(subscr->rediscover, 1);
+}
+
+static void rediscover_cb(pa_mainloop_api *m, pa_defer_event *e, void *userdata)
+{
+    struct userdata      *u = userdata;
+    struct pa_sinp_evsubscr *subscr;
     void                 *state = NULL;
     pa_idxset            *idxset;
     struct pa_sink_input *sinp;
@@ -123,17 +159,27 @@ void  pa_sink_input_ext_rediscover(struct userdata *u)
     uint32_t              old_corked_state;
     uint32_t              old_muted_state;
     const char           *group_name;
+    const char           *app_id;
     const char           *clear[3] = { PA_PROP_POLICY_GROUP, PA_PROP_POLICY_STREAM_FLAGS, NULL };
 
     pa_assert(u);
     pa_assert(u->core);
+    pa_assert_se((subscr = u->ssi));
     pa_assert_se((idxset = u->core->sink_inputs));
 
+    m->defer_enable(e, 0);
+
     while ((sinp = pa_idxset_iterate(idxset, &state, NULL)) != NULL) {
         group_name = pa_proplist_gets(sinp->proplist, PA_PROP_POLICY_GROUP);
         if (!group_name)
             continue;
-        if (!pa_streq(group_name, "othermedia"))
+        if (!pa_streq(group_name, PA_POLICY_DEFAULT_GROUP_NAME))
+            continue;
+
+        /* only the streams of the registered applications can change */
+        if (!sinp->client || !(app_id = pa_client_ext_app_id(sinp->client)))
+            continue;
+        if (!pa_hashmap_get(subscr->app_ids, app_id))
             continue;
 
         pa_log_debug("rediscover sink-input \"%s\"", pa_sink_input_ext_get_name(sinp));
@@ -145,6 +191,8 @@ void  pa_sink_input_ext_rediscover(struct userdata *u)
         pa_proplist_unset_many(sinp->proplist, clear);
         handle_new_sink_input(u, sinp, &old_corked_state, &old_muted_state);
     }
+
+    pa_hashmap_remove_all(subscr->app_ids);
 }
 
 struct pa_sink_input_ext *pa_sink_input_ext_lookup(struct userdata      *u,
@@ -245,10 +293,15 @@ int pa_sink_input_ext_set_volume_limit(struct userdata *u,
 
         if (!(ext = pa_sink_input_ext_lookup(u, sinp)))
             retval = -1;
-        else {
+        else if (ext->local.volume_limit_enabled &&
+                 ext->local.volume_limit == limit) {
+            /* the factor is already in place */
+        }
+        else if (ext->local.volume_limit_enabled || limit < PA_VOLUME_NORM) {
             sink_input_ext_unset_volume_limit(ext, sinp);
             if (limit < PA_VOLUME_NORM) {
                 ext->local.volume_limit_enabled = true;
+                ext->local.volume_limit = limit;
                 pa_cvolume_set(&volume, sinp->sample_spec.channels, limit);
                 pa_sink_input_add_volume_factor(sinp, VOLUME_LIMIT_FACTOR_KEY, &volume);
             }
@@ -477,6 +530,9 @@ static void handle_new_sink_input(struct userdata      *u,
         ext->local.route = (flags & PA_POLICY_LOCAL_ROUTE) ? true : false;
         ext->local.mute  = (flags & PA_POLICY_LOCAL_MUTE ) ? true : false;
 
+        /* the value of an existing factor is not known, so it is not
+         * taken as already in place on the next limit change */
+        ext->local.volume_limit = PA_VOLUME_INVALID;
         if (pa_hashmap_get(sinp->volume_factor_items, VOLUME_LIMIT_FACTOR_KEY))
             ext->local.volume_limit_enabled = true;
 
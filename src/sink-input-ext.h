@@ -19,6 +19,9 @@ struct pa_sinp_evsubscr {
     pa_hook_slot    *unlink;
     pa_hook_slot    *cork_state;
     pa_hook_slot    *mute_state;
+    pa_mainloop_api *mainloop;
+    pa_defer_event  *rediscover;     /* deferred re-classification */
+    pa_hashmap      *app_ids;        /* app_ids registered since the last one */
 };
 
 enum pa_sink_input_ext_state {
@@ -27,7 +30,10 @@ enum pa_sink_input_ext_state {
     PA_SINK_INPUT_EXT_STATE_POLICY  = 1 << 1
 };
 
+struct pa_sink_input_list;
+
 struct pa_sink_input_ext {
+    struct pa_sink_input_list *member;  /* entry in the group's stream list */
     struct {
         int route;
         int mute;
@@ -36,14 +42,17 @@ struct pa_sink_input_ext {
         uint32_t mute_state;
         bool ignore_mute_state_change;
         bool volume_limit_enabled;
+        pa_volume_t volume_limit;   /* limit of the volume factor, or
+                                       PA_VOLUME_INVALID if not known */
     }                local;     /* local policies */
 };
 
 struct pa_sinp_evsubscr *pa_sink_input_ext_subscription(struct userdata *);
 void  pa_sink_input_ext_subscription_free(struct pa_sinp_evsubscr *);
 void  pa_sink_input_ext_discover(struct userdata *);
-/* Go through all othermedia streams and re-classify them. */
-void  pa_sink_input_ext_rediscover(struct userdata *u);
+/* Re-classify the othermedia streams of the clients with the given app_id.
+ * Requests made in the same main loop iteration are handled in one pass. */
+void  pa_sink_input_ext_rediscover(struct userdata *u, const char *app_id);
 struct pa_sink_input_ext *pa_sink_input_ext_lookup(struct userdata *,
                                                    struct pa_sink_input *);
 int   pa_sink_input_ext_set_policy_group(struct pa_sink_input *, const char *);
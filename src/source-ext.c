@@ -206,7 +206,7 @@ static void handle_new_source(struct userdata *u, struct pa_source *source)
     uint32_t         idx;
     char            *buf;
     int              ret;
-    struct pa_classify_result *r;
+    struct pa_classify_result  r;
 
     if (source && u) {
         name = pa_source_ext_get_name(source);
@@ -220,7 +220,7 @@ static void handle_new_source(struct userdata *u, struct pa_source *source)
 
         if (pa_policy_log_level_debug()) {
             pa_classify_source(u, source, 0, 0, &r);
-            buf = pa_policy_log_concat(r->types, r->count);
+            buf = pa_classify_result_to_string(u, &r);
             ret = pa_proplist_sets(source->proplist,
                                    PA_PROP_POLICY_DEVTYPELIST, buf);
 
@@ -229,9 +229,8 @@ static void handle_new_source(struct userdata *u, struct pa_source *source)
                        PA_PROP_POLICY_DEVTYPELIST, name);
 
             pa_log_debug("new source '%s' (idx=%d%s%s)",
-                         name, idx, r->count > 0 ? ", type=" : "", buf);
+                         name, idx, pa_classify_result_count(&r) > 0 ? ", type=" : "", buf);
             pa_xfree(buf);
-            pa_xfree(r);
         }
 
         pa_policy_context_register(u,pa_policy_object_source,name,source);
@@ -241,8 +240,7 @@ static void handle_new_source(struct userdata *u, struct pa_source *source)
         pa_policy_groupset_register_source(u, source);
 
         pa_classify_source(u, source, PA_POLICY_DISABLE_NOTIFY, 0, &r);
-        pa_policy_send_device_state(u, PA_POLICY_CONNECTED, r);
-        pa_xfree(r);
+        pa_policy_send_device_state(u, PA_POLICY_CONNECTED, &r);
 
         pa_policy_groupset_update_sources(u);
     }
@@ -254,7 +252,7 @@ static void handle_removed_source(struct userdata *u, struct pa_source *source)
     uint32_t         idx;
     char            *buf;
     struct pa_null_source     *ns;
-    struct pa_classify_result *r;
+    struct pa_classify_result  r;
 
     if (source && u) {
         name = pa_source_ext_get_name(source);
@@ -272,11 +270,10 @@ static void handle_removed_source(struct userdata *u, struct pa_source *source)
 
         if (pa_policy_log_level_debug()) {
             pa_classify_source(u, source, 0, 0, &r);
-            buf = pa_policy_log_concat(r->types, r->count);
+            buf = pa_classify_result_to_string(u, &r);
             pa_log_debug("remove source '%s' (idx=%d%s%s)",
-                         name, idx, r->count > 0 ? ", type=" : "", buf);
+                         name, idx, pa_classify_result_count(&r) > 0 ? ", type=" : "", buf);
             pa_xfree(buf);
-            pa_xfree(r);
         }
 
 #if 0
@@ -285,8 +282,7 @@ static void handle_removed_source(struct userdata *u, struct pa_source *source)
         pa_policy_groupset_unregister_source(u, idx);
 
         pa_classify_source(u, source, PA_POLICY_DISABLE_NOTIFY, 0, &r);
-        pa_policy_send_device_state(u, PA_POLICY_DISCONNECTED, r);
-        pa_xfree(r);
+        pa_policy_send_device_state(u, PA_POLICY_DISCONNECTED, &r);
     }
 }
 
@@ -13,6 +13,8 @@
 #define PA_PROP_POLICY_STREAM_FLAGS      "policy.stream_flags"
 #define PA_PROP_POLICY_DEVTYPELIST       "policy.device.typelist"
 #define PA_PROP_POLICY_CARDTYPELIST      "policy.card.typelist"
+#define PA_PROP_POLICY_GROUP_STATS       "policy.group.%s.stats"
+#define PA_PROP_POLICY_UID_CACHE_STATS   "policy.uid_cache.stats"
 #define PA_PROP_MAEMO_AUDIO_MODE         "x-maemo.mode"
 #define PA_PROP_MAEMO_ACCESSORY_HWID     "x-maemo.accessory_hwid"
 
@@ -29,6 +31,8 @@ struct pa_classify;
 struct pa_policy_context;
 struct pa_policy_dbusif;
 struct pa_policy_variable;
+struct pa_policy_atoms;
+struct pa_policy_match_keys;
 struct pa_sink_ext_data;
 struct pa_port_ext;
 
@@ -51,6 +55,8 @@ struct userdata {
     struct pa_policy_context  *context;  /* for processing context variables */
     struct pa_policy_dbusif   *dbusif;
     struct pa_policy_variable *vars;
+    struct pa_policy_atoms    *atoms;    /* interned names */
+    struct pa_policy_match_keys *match_keys; /* property match key ids */
     struct pa_sink_ext_data   *sinkext;
     struct pa_port_evsubscr   *portext;
     pa_shared_data            *shared;   /* for forwarding context etc properties */